@@ -28,12 +28,12 @@
 /* Arduino libraries */
 #include <Arduino.h>
 #include "Thread.h"
-#include "ThreadController.h"
 #include <TimerOne.h>
 #include <Wire.h>
 #include <helper_3dmath.h>
 
 /* Open DSKY headers */
+#include "Scheduler.h"
 #include "main.h"
 #include "Neopixels.h"
 #include "IMU.h"
@@ -44,10 +44,11 @@
 #include "GPS.h"
 #include "Sound.h"
 #include "Launch.h"
+#include "Idle.h"
 
 
-/* ThreadController that will controll all threads */
-ThreadController controll = ThreadController();
+/* Scheduler that will controll all threads */
+Scheduler controll = Scheduler();
 
 /* Per hardware diver setup */
 void setup()
@@ -72,6 +73,7 @@ void loop()
 {
 
 		controll.run();
-		ProgramTask(); /* Program Task shedules handles all the programs, it also acts as the
-	                      idle task, nothing else should be added to the loop(); */
+		ProgramTask(); /* Program Task shedules handles all the programs, nothing
+	                      else should be added to the loop(); */
+		IdleSleep();   /* Sleep until the next interrupt when no thread is due */
 }
@@ -22,7 +22,6 @@
 
 #include <Wire.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 
 /* Open DSKY headers */
@@ -30,16 +29,45 @@
 #include "Program.h"
 #include "Sound.h"
 #include "DiagnosticPrograms.h"
+#include "ThreadPool.h"
+#include "Idle.h"
+#include "Keyboard.h"
+#include "Latency.h"
+#include "GPS.h"
+#include "Scheduler.h"
 #include "main.h"
 
 
 Thread* V35Thread = NULL;
-static SevenSegmentDisplayStruct DiagnosticProgramDisplayData;
+Thread* V16N97Thread = NULL;
+Thread* V16N96Thread = NULL;
+Thread* V16N95Thread = NULL;
+Thread* V25N94Thread = NULL;
+Thread* V16N93Thread = NULL;
+Thread* V16N92Thread = NULL;
+static SevenSegmentFrameStruct DiagnosticProgramFrame;
 
+/* Keyboard calibration, a row reading below V25N94_PRESSED means a key is
+   pressed. Each key is read V25N94_SAMPLES times, after V25N94_SETTLE reads
+   to let it stop bouncing, and calibration gives up if no key is pressed for
+   V25N94_TIMEOUT reads. */
+#define V25N94_INTERVAL_MS 20U
+#define V25N94_PRESSED     980U
+#define V25N94_SETTLE      5U
+#define V25N94_SAMPLES     16U
+#define V25N94_TIMEOUT     (30000U / V25N94_INTERVAL_MS)
+#define V25N94_NUM_KEYS    (KEYBOARD_NUM_ROWS * KEYBOARD_ROW_KEYS)
 
-SevenSegmentDisplayStruct* DiagnosticGetDisplayData(void)
+static uint8_t V25N94Key;
+static uint8_t V25N94Samples;
+static uint16_t V25N94Sum;
+static uint16_t V25N94IdleCount;
+static bool V25N94Saved;
+
+
+const SevenSegmentDisplayStruct* DiagnosticGetDisplayData(void)
 {
-		return &DiagnosticProgramDisplayData;
+		return SevenSegmentFrontBuffer(&DiagnosticProgramFrame);
 }
 
 /**
@@ -64,11 +92,8 @@ ProgramRunStateEnum V35BulbTest(ProgramCallStateEnum call)
 				/* Check if the thread already exists before we try to create it. */
 				if(V35Thread == NULL)
 				{
-						V35Thread = new Thread();
-						V35Thread->onRun(V35ThreadCallback);
-						V35Thread->setInterval(20);
-						controll.add(V35Thread);
-						return FOREGROUND;
+						V35Thread = ThreadPoolAcquire(V35ThreadCallback, 20);
+						return (V35Thread != NULL) ? FOREGROUND : NOT_RUNNING;
 				}
 
 				break;
@@ -95,8 +120,7 @@ ProgramRunStateEnum V35BulbTest(ProgramCallStateEnum call)
 						{
 								NeoPixelSetState(i,RAINBOW_COLOUR,PIXEL_OFF);
 						}
-						controll.remove(V35Thread);
-						delete[] V35Thread;
+						ThreadPoolRelease(V35Thread);
 						V35Thread = NULL;
 				}
 				return NOT_RUNNING;
@@ -115,17 +139,18 @@ ProgramRunStateEnum V35BulbTest(ProgramCallStateEnum call)
  */
 void V35ThreadCallback(void)
 {
+		SevenSegmentDisplayStruct* displayData;
 		uint16_t moduleTime = (millis()%12000);
 
-		DiagnosticProgramDisplayData.R1DigitShowMask = 0x3F;
-		DiagnosticProgramDisplayData.R2DigitShowMask = 0x3F;
-		DiagnosticProgramDisplayData.R3DigitShowMask = 0x3F;
-		DiagnosticProgramDisplayData.Prog = 0;
-		DiagnosticProgramDisplayData.Noun = 0;
-		DiagnosticProgramDisplayData.Verb = 35;
-		DiagnosticProgramDisplayData.R1 = 12345;
-		DiagnosticProgramDisplayData.R2 = -67890;
-		DiagnosticProgramDisplayData.R3 = -91827;
+		displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(0);
+		displayData->Verb = SEVEN_SEGMENT_PAIR(35);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, 12345, 0x3F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, -67890, 0x3F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, -91827, 0x3F);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&DiagnosticProgramFrame);
 
 
 		for(uint8_t i = 0; i <NUM_PIXELS; i++)
@@ -217,3 +242,514 @@ ProgramRunStateEnum V21N98SoundTest(ProgramCallStateEnum call)
 		}
 		return NOT_RUNNING;
 }
+
+
+/**
+ * V16N97ThreadCallback
+ *
+ * Shows how many threads are in use from the program thread pool (R1), the
+ * most that have been in use at once (R2), and the size of the pool (R3).
+ */
+void V16N97ThreadCallback(void)
+{
+		SevenSegmentDisplayStruct* displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)ThreadPoolInUse(), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)ThreadPoolPeak(), 0x3);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)THREAD_POOL_SIZE, 0x3);
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(97);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&DiagnosticProgramFrame);
+}
+
+
+/**
+ * V16N97ShowThreadPool
+ *
+ * Verb 16 Noun 97 shows the program thread pool occupancy. The program can
+ * only run in the foreground.
+ * @param  call - a ProgramCallStateEnum this should be START_PROGRAM
+ * @return - a ProgramRunStateEnum with whether the program is running in the
+ *           foreground, background or not at all.
+ */
+ProgramRunStateEnum V16N97ShowThreadPool(ProgramCallStateEnum call)
+{
+		switch(call)
+		{
+		case RESET_PROGRAM:
+		case START_PROGRAM:
+		case BRING_PROGRAM_TO_FOREGROUND:
+				/* Check if the thread already exists before we try to create it. */
+				if(V16N97Thread == NULL)
+				{
+						V16N97Thread = ThreadPoolAcquire(V16N97ThreadCallback, 500);
+						if(V16N97Thread != NULL)
+						{
+								V16N97ThreadCallback();
+						}
+				}
+				return (V16N97Thread != NULL) ? FOREGROUND : NOT_RUNNING;
+				break;
+
+		/* this program only runs in FOREGROUND , evreything else will turn it off*/
+		case PAUSE_PROGRAM:
+		case UNPAUSE_PROGRAM:
+		case PUSH_PROGRAM_TO_BACKGROUND:
+		case STOP_PROGRAM:
+		case NUM_CALL_STATES:
+		default:
+				if(V16N97Thread != NULL)
+				{
+						ThreadPoolRelease(V16N97Thread);
+						V16N97Thread = NULL;
+				}
+				return NOT_RUNNING;
+				break;
+		}
+		return NOT_RUNNING;
+}
+
+
+/**
+ * V16N96ThreadCallback
+ *
+ * Shows the percentage of the last second that the processor spent asleep
+ * (R1), how many times it woke up in that second (R2), and how many threads
+ * are in the scheduler (R3).
+ */
+void V16N96ThreadCallback(void)
+{
+		SevenSegmentDisplayStruct* displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)IdleResidency(), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)IdleWakeups(), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)controll.size(), 0x3);
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(96);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&DiagnosticProgramFrame);
+}
+
+
+/**
+ * V16N96ShowIdle
+ *
+ * Verb 16 Noun 96 shows how much of the time the processor is idle. The
+ * program can only run in the foreground.
+ * @param  call - a ProgramCallStateEnum this should be START_PROGRAM
+ * @return - a ProgramRunStateEnum with whether the program is running in the
+ *           foreground, background or not at all.
+ */
+ProgramRunStateEnum V16N96ShowIdle(ProgramCallStateEnum call)
+{
+		switch(call)
+		{
+		case RESET_PROGRAM:
+		case START_PROGRAM:
+		case BRING_PROGRAM_TO_FOREGROUND:
+				/* Check if the thread already exists before we try to create it. */
+				if(V16N96Thread == NULL)
+				{
+						V16N96Thread = ThreadPoolAcquire(V16N96ThreadCallback, 1000);
+						if(V16N96Thread != NULL)
+						{
+								V16N96ThreadCallback();
+						}
+				}
+				return (V16N96Thread != NULL) ? FOREGROUND : NOT_RUNNING;
+				break;
+
+		/* this program only runs in FOREGROUND , evreything else will turn it off*/
+		case PAUSE_PROGRAM:
+		case UNPAUSE_PROGRAM:
+		case PUSH_PROGRAM_TO_BACKGROUND:
+		case STOP_PROGRAM:
+		case NUM_CALL_STATES:
+		default:
+				if(V16N96Thread != NULL)
+				{
+						ThreadPoolRelease(V16N96Thread);
+						V16N96Thread = NULL;
+				}
+				return NOT_RUNNING;
+				break;
+		}
+		return NOT_RUNNING;
+}
+
+
+/**
+ * V16N95ThreadCallback
+ *
+ * Shows the percentage of the last second spent running thread callbacks
+ * (R1), the longest any callback has taken in microseconds (R2), and how
+ * many times the loop ran in the last second (R3).
+ */
+void V16N95ThreadCallback(void)
+{
+		SevenSegmentDisplayStruct* displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)controll.load(), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)min(controll.worstMicros(), 99999UL), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)controll.loopRate(), 0x1F);
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(95);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&DiagnosticProgramFrame);
+}
+
+
+/**
+ * V16N95ShowLoad
+ *
+ * Verb 16 Noun 95 shows the load on the scheduler, and prints the timings of
+ * each thread to the serial port when it starts. The program can only run in
+ * the foreground.
+ * @param  call - a ProgramCallStateEnum this should be START_PROGRAM
+ * @return - a ProgramRunStateEnum with whether the program is running in the
+ *           foreground, background or not at all.
+ */
+ProgramRunStateEnum V16N95ShowLoad(ProgramCallStateEnum call)
+{
+		switch(call)
+		{
+		case RESET_PROGRAM:
+		case START_PROGRAM:
+		case BRING_PROGRAM_TO_FOREGROUND:
+				/* Check if the thread already exists before we try to create it. */
+				if(V16N95Thread == NULL)
+				{
+						V16N95Thread = ThreadPoolAcquire(V16N95ThreadCallback, 1000);
+						if(V16N95Thread != NULL)
+						{
+								V16N95ThreadCallback();
+								controll.report();
+						}
+				}
+				return (V16N95Thread != NULL) ? FOREGROUND : NOT_RUNNING;
+				break;
+
+		/* this program only runs in FOREGROUND , evreything else will turn it off*/
+		case PAUSE_PROGRAM:
+		case UNPAUSE_PROGRAM:
+		case PUSH_PROGRAM_TO_BACKGROUND:
+		case STOP_PROGRAM:
+		case NUM_CALL_STATES:
+		default:
+				if(V16N95Thread != NULL)
+				{
+						ThreadPoolRelease(V16N95Thread);
+						V16N95Thread = NULL;
+				}
+				return NOT_RUNNING;
+				break;
+		}
+		return NOT_RUNNING;
+}
+
+
+/**
+ * V25N94NextKey
+ *
+ * Moves the keyboard calibration on to the next key, skipping the empty
+ * positions at the end of the rows.
+ */
+static void V25N94NextKey(void)
+{
+		V25N94Samples = 0U;
+		V25N94Sum = 0U;
+		do
+		{
+				V25N94Key++;
+		}
+		while((V25N94Key < V25N94_NUM_KEYS) &&
+		      (KeyboardRowKey(V25N94Key / KEYBOARD_ROW_KEYS, V25N94Key % KEYBOARD_ROW_KEYS) == KEY_NONE));
+}
+
+
+/**
+ * V25N94ThreadCallback
+ *
+ * Asks for each key on the keyboard to be pressed in turn, by showing its row
+ * (R1) and position along the row (R2), with VERB and NOUN flashing. The
+ * reading of the row is shown in R3. Once every key has been pressed the new
+ * key thresholds are saved, and R1 shows 1 if they were good or 0 if they
+ * were not, or if calibration timed out.
+ */
+void V25N94ThreadCallback(void)
+{
+		SevenSegmentDisplayStruct* displayData;
+		uint8_t row = V25N94Key / KEYBOARD_ROW_KEYS;
+		uint8_t position = V25N94Key % KEYBOARD_ROW_KEYS;
+		uint16_t value = 0U;
+
+		if(V25N94Key < V25N94_NUM_KEYS)
+		{
+				value = KeyboardCalibrateRead(row);
+				if(value < V25N94_PRESSED)
+				{
+						V25N94IdleCount = 0U;
+						if(V25N94Samples < (V25N94_SETTLE + V25N94_SAMPLES))
+						{
+								V25N94Samples++;
+								if(V25N94Samples > V25N94_SETTLE)
+								{
+										V25N94Sum += value;
+								}
+								if(V25N94Samples == (V25N94_SETTLE + V25N94_SAMPLES))
+								{
+										KeyboardCalibrateKey(row, position, V25N94Sum / V25N94_SAMPLES);
+								}
+						}
+				}
+				else if(V25N94Samples == (V25N94_SETTLE + V25N94_SAMPLES))
+				{
+						/* the key has been read and let go of */
+						V25N94NextKey();
+						if(V25N94Key >= V25N94_NUM_KEYS)
+						{
+								V25N94Saved = KeyboardCalibrateFinish();
+						}
+				}
+				else
+				{
+						/* let go of too soon, start again */
+						V25N94Samples = 0U;
+						V25N94Sum = 0U;
+						V25N94IdleCount++;
+						if(V25N94IdleCount >= V25N94_TIMEOUT)
+						{
+								KeyboardCalibrateCancel();
+								V25N94Key = V25N94_NUM_KEYS;
+								V25N94Saved = false;
+						}
+				}
+		}
+
+		displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+		displayData->Verb = SEVEN_SEGMENT_PAIR(25);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(94);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		if(V25N94Key < V25N94_NUM_KEYS)
+		{
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)(row + 1U), 0x1);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)(position + 1U), 0x1);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)value, 0xF);
+				displayData->Flags = SEVEN_SEGMENT_FLASH_VERB | SEVEN_SEGMENT_FLASH_NOUN;
+		}
+		else
+		{
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, V25N94Saved ? 1 : 0, 0x1);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, 0, 0x0);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, 0, 0x0);
+				displayData->Flags = 0U;
+		}
+		SevenSegmentPublishFrame(&DiagnosticProgramFrame);
+}
+
+
+/**
+ * V25N94CalibrateKeyboard
+ *
+ * Verb 25 Noun 94 calibrates the keyboard, press each key when its row and
+ * position are shown. The keyboard doesn't work while it is being calibrated.
+ * The program can only run in the foreground, and stopping it part way
+ * through keeps the old calibration.
+ * @param  call - a ProgramCallStateEnum this should be START_PROGRAM
+ * @return - a ProgramRunStateEnum with whether the program is running in the
+ *           foreground, background or not at all.
+ */
+ProgramRunStateEnum V25N94CalibrateKeyboard(ProgramCallStateEnum call)
+{
+		switch(call)
+		{
+		case RESET_PROGRAM:
+		case START_PROGRAM:
+		case BRING_PROGRAM_TO_FOREGROUND:
+				/* Check if the thread already exists before we try to create it. */
+				if(V25N94Thread == NULL)
+				{
+						if(!KeyboardCalibrateStart())
+						{
+								return NOT_RUNNING;
+						}
+						V25N94Thread = ThreadPoolAcquire(V25N94ThreadCallback, V25N94_INTERVAL_MS);
+						if(V25N94Thread == NULL)
+						{
+								KeyboardCalibrateCancel();
+								return NOT_RUNNING;
+						}
+						V25N94Key = 0U;
+						V25N94Samples = 0U;
+						V25N94Sum = 0U;
+						V25N94IdleCount = 0U;
+						V25N94Saved = false;
+						V25N94ThreadCallback();
+				}
+				return FOREGROUND;
+				break;
+
+		/* this program only runs in FOREGROUND , evreything else will turn it off*/
+		case PAUSE_PROGRAM:
+		case UNPAUSE_PROGRAM:
+		case PUSH_PROGRAM_TO_BACKGROUND:
+		case STOP_PROGRAM:
+		case NUM_CALL_STATES:
+		default:
+				if(V25N94Thread != NULL)
+				{
+						SevenSegmentDisplayStruct* displayData;
+
+						KeyboardCalibrateCancel();
+						ThreadPoolRelease(V25N94Thread);
+						V25N94Thread = NULL;
+						/* the other diagnostic programs share the frame, so
+						   don't leave it flashing */
+						displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+						displayData->Flags = 0U;
+						SevenSegmentPublishFrame(&DiagnosticProgramFrame);
+				}
+				return NOT_RUNNING;
+				break;
+		}
+		return NOT_RUNNING;
+}
+
+
+/**
+ * V16N93ThreadCallback
+ *
+ * Shows how many milliseconds the last key press took to reach the display
+ * (R1), the time 95% of key presses reached it within (R2), and the worst
+ * time (R3).
+ */
+void V16N93ThreadCallback(void)
+{
+		SevenSegmentDisplayStruct* displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)LatencyLastMillis(), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)LatencyPercentileMillis(95U), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)LatencyWorstMillis(), 0x1F);
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(93);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&DiagnosticProgramFrame);
+}
+
+
+/**
+ * V16N93ShowLatency
+ *
+ * Verb 16 Noun 93 shows how long key presses take to reach the display, and
+ * prints the latency histograms to the serial port when it starts. The
+ * program can only run in the foreground.
+ * @param  call - a ProgramCallStateEnum this should be START_PROGRAM
+ * @return - a ProgramRunStateEnum with whether the program is running in the
+ *           foreground, background or not at all.
+ */
+ProgramRunStateEnum V16N93ShowLatency(ProgramCallStateEnum call)
+{
+		switch(call)
+		{
+		case RESET_PROGRAM:
+		case START_PROGRAM:
+		case BRING_PROGRAM_TO_FOREGROUND:
+				/* Check if the thread already exists before we try to create it. */
+				if(V16N93Thread == NULL)
+				{
+						V16N93Thread = ThreadPoolAcquire(V16N93ThreadCallback, 1000);
+						if(V16N93Thread != NULL)
+						{
+								V16N93ThreadCallback();
+								LatencyReport();
+						}
+				}
+				return (V16N93Thread != NULL) ? FOREGROUND : NOT_RUNNING;
+				break;
+
+		/* this program only runs in FOREGROUND , evreything else will turn it off*/
+		case PAUSE_PROGRAM:
+		case UNPAUSE_PROGRAM:
+		case PUSH_PROGRAM_TO_BACKGROUND:
+		case STOP_PROGRAM:
+		case NUM_CALL_STATES:
+		default:
+				if(V16N93Thread != NULL)
+				{
+						ThreadPoolRelease(V16N93Thread);
+						V16N93Thread = NULL;
+				}
+				return NOT_RUNNING;
+				break;
+		}
+		return NOT_RUNNING;
+}
+
+
+/**
+ * V16N92ThreadCallback
+ *
+ * Shows how many ticks the neopixels have waited for GPS bytes (R1), how many
+ * times they were sent while GPS bytes were waiting anyway (R2), and how many GPS
+ * sentences have failed their checksum (R3).
+ */
+void V16N92ThreadCallback(void)
+{
+		SevenSegmentDisplayStruct* displayData = SevenSegmentBeginFrame(&DiagnosticProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)NeoPixelDeferredCommits(), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)NeoPixelOverlappedCommits(), 0x1F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)min(GPSChecksumFailures(), 99999UL), 0x1F);
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(92);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&DiagnosticProgramFrame);
+}
+
+
+/**
+ * V16N92ShowBusContention
+ *
+ * Verb 16 Noun 92 shows how the neopixels and the GPS are sharing the
+ * processor. The program can only run in the foreground.
+ * @param  call - a ProgramCallStateEnum this should be START_PROGRAM
+ * @return - a ProgramRunStateEnum with whether the program is running in the
+ *           foreground, background or not at all.
+ */
+ProgramRunStateEnum V16N92ShowBusContention(ProgramCallStateEnum call)
+{
+		switch(call)
+		{
+		case RESET_PROGRAM:
+		case START_PROGRAM:
+		case BRING_PROGRAM_TO_FOREGROUND:
+				/* Check if the thread already exists before we try to create it. */
+				if(V16N92Thread == NULL)
+				{
+						V16N92Thread = ThreadPoolAcquire(V16N92ThreadCallback, 1000);
+						if(V16N92Thread != NULL)
+						{
+								V16N92ThreadCallback();
+						}
+				}
+				return (V16N92Thread != NULL) ? FOREGROUND : NOT_RUNNING;
+				break;
+
+		/* this program only runs in FOREGROUND , evreything else will turn it off*/
+		case PAUSE_PROGRAM:
+		case UNPAUSE_PROGRAM:
+		case PUSH_PROGRAM_TO_BACKGROUND:
+		case STOP_PROGRAM:
+		case NUM_CALL_STATES:
+		default:
+				if(V16N92Thread != NULL)
+				{
+						ThreadPoolRelease(V16N92Thread);
+						V16N92Thread = NULL;
+				}
+				return NOT_RUNNING;
+				break;
+		}
+		return NOT_RUNNING;
+}
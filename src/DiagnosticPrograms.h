@@ -27,5 +27,17 @@ extern ProgramRunStateEnum V35BulbTest(ProgramCallStateEnum call);
 extern void V35ThreadCallback();
 extern ProgramRunStateEnum V21N98GiveData(uint8_t dataIdx,int32_t data);
 extern ProgramRunStateEnum V21N98SoundTest(ProgramCallStateEnum call);
-extern SevenSegmentDisplayStruct* DiagnosticGetDisplayData(void);
+extern const SevenSegmentDisplayStruct* DiagnosticGetDisplayData(void);
+extern void V16N97ThreadCallback(void);
+extern ProgramRunStateEnum V16N97ShowThreadPool(ProgramCallStateEnum call);
+extern void V16N96ThreadCallback(void);
+extern ProgramRunStateEnum V16N96ShowIdle(ProgramCallStateEnum call);
+extern void V16N95ThreadCallback(void);
+extern ProgramRunStateEnum V16N95ShowLoad(ProgramCallStateEnum call);
+extern void V25N94ThreadCallback(void);
+extern ProgramRunStateEnum V25N94CalibrateKeyboard(ProgramCallStateEnum call);
+extern void V16N93ThreadCallback(void);
+extern ProgramRunStateEnum V16N93ShowLatency(ProgramCallStateEnum call);
+extern void V16N92ThreadCallback(void);
+extern ProgramRunStateEnum V16N92ShowBusContention(ProgramCallStateEnum call);
 #endif
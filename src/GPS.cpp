@@ -34,12 +34,12 @@
  */
 #include <Wire.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 #include <TinyGPS++.h>
 #include <digitalWriteFast.h>
 
 /* Open DSKY headers */
+#include "Scheduler.h"
 #include "main.h"
 #include "Neopixels.h"
 #include "GPS.h"
@@ -49,7 +49,7 @@
 
 TinyGPSPlus gps;
 
-Thread* GPSThread = new Thread();
+SchedulerThread* GPSThread = new SchedulerThread();
 
 
 typedef struct GPS_DATA_STRUCT
@@ -175,6 +175,33 @@ void GPSThreadCallback(void)
 }
 
 
+/**
+ * GPSSerialBusy
+ *
+ * Anything that turns interrupts off for a while, such as sending the
+ * neopixels, should wait until this is false, or the bytes coming in from the
+ * GPS could be lost. Bytes arrive in bursts of a sentence at a time, so bytes
+ * waiting to be read mean more are probably on their way.
+ * @return  true if there are bytes in the serial receive buffer waiting to be
+ *          read
+ */
+bool GPSSerialBusy(void)
+{
+		return (Serial.available() > 0);
+}
+
+
+/**
+ * GPSChecksumFailures
+ *
+ * @return  the number of sentences from the GPS that have failed their checksum
+ */
+uint32_t GPSChecksumFailures(void)
+{
+		return gps.failedChecksum();
+}
+
+
 /**
  * GPSGetHour
  *
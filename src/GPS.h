@@ -27,6 +27,8 @@
 
 extern void GPSSetup(void);
 extern void GPSThreadCallback(void);
+extern bool GPSSerialBusy(void);
+extern uint32_t GPSChecksumFailures(void);
 
 extern uint8_t GPSGetHour(void);
 extern uint8_t GPSGetMinute(void);
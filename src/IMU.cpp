@@ -35,10 +35,10 @@
 #include "MPU6050.h"
 #include <helper_3dmath.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 
 #include "IMU.h"
+#include "Scheduler.h"
 #include "main.h"
 
 
@@ -46,7 +46,7 @@
 
 MPU6050 mpu(0x69);
 
-Thread* IMUThread = new Thread();
+SchedulerThread* IMUThread = new SchedulerThread();
 
 typedef struct IMU_DATA
 {
@@ -0,0 +1,118 @@
+/*
+ * Idle.cpp
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * Idle task, puts the processor to sleep when no thread is due to run.
+ * SLEEP_MODE_IDLE only stops the CPU clock, so the timers, serial port, ADC
+ * and external interrupts all keep going, and any one of them wakes it up
+ * again. Timer0 interrupts every 1.024ms to keep millis() going, so the
+ * processor never sleeps for longer than that, and a wakeup is never more
+ * than a millisecond late for a deadline.
+ *
+ * Comment out #define IDLE_SLEEP to make the loop spin as it used to, the
+ * idle residency will then read as 0.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <Arduino.h>
+#include <Thread.h>
+#include <avr/sleep.h>
+
+/* Open DSKY headers */
+#include "Idle.h"
+#include "Keyboard.h"
+#include "Scheduler.h"
+#include "main.h"
+
+#define IDLE_SLEEP
+
+/* Time over which the idle residency is measured */
+#define IDLE_WINDOW_US 1000000UL
+
+static unsigned long idleWindowStart = 0UL;
+static unsigned long idleWindowMicros = 0UL;
+static uint16_t idleWindowWakeups = 0U;
+static uint8_t idleResidency = 0U;
+static uint16_t idleWakeups = 0U;
+
+
+/**
+ * IdleSleep
+ *
+ * Sleeps until the next interrupt if no thread is due to run and there are
+ * no key events waiting for ProgramTask. Call once per loop.
+ */
+void IdleSleep(void)
+{
+		unsigned long now;
+
+#ifdef IDLE_SLEEP
+		noInterrupts();
+		if((!controll.due()) && (!KeyboardEventPending()))
+		{
+				unsigned long start = micros();
+
+				set_sleep_mode(SLEEP_MODE_IDLE);
+				sleep_enable();
+				/* The instruction after sei always runs before any interrupt, so an
+				   interrupt can not sneak in between the checks above and going to
+				   sleep, and leave us asleep with work to do */
+				interrupts();
+				sleep_cpu();
+				sleep_disable();
+
+				idleWindowMicros += micros() - start;
+				idleWindowWakeups++;
+		}
+		interrupts();
+#endif
+
+		/* Work out the residency once per window */
+		now = micros();
+		if((now - idleWindowStart) >= IDLE_WINDOW_US)
+		{
+				unsigned long residency = idleWindowMicros / ((now - idleWindowStart) / 100UL);
+				idleResidency = (residency > 100UL) ? 100U : (uint8_t)residency;
+				idleWakeups = idleWindowWakeups;
+				idleWindowStart = now;
+				idleWindowMicros = 0UL;
+				idleWindowWakeups = 0U;
+		}
+}
+
+
+/**
+ * IdleResidency
+ *
+ * @return  the percentage of the last second spent idle
+ */
+uint8_t IdleResidency(void)
+{
+		return idleResidency;
+}
+
+
+/**
+ * IdleWakeups
+ *
+ * @return  the number of times the processor woke from idle in the last second
+ */
+uint16_t IdleWakeups(void)
+{
+		return idleWakeups;
+}
@@ -10,6 +10,22 @@
  * rather than pressing buttons. The serial keybaord does not play nicely with
  * the GPS driver, as they use the same serial lines.
  *
+ * Every debounced key press and release is put into a timestamped event queue,
+ * so that keys typed while the main loop is busy are not lost.
+ *
+ * The three rows of the physical keyboard are read by the ADC in the
+ * background. Timer0 (which also runs millis()) starts a conversion on its
+ * compare match A, about once a millisecond, and the ADC interrupt works out
+ * which key the row shows, moves on to the next row, and debounces the key
+ * once all three rows have been read. A key on one row and a key on another
+ * row can be held together as a chord. The main loop never waits for the ADC,
+ * and nothing else should use analogRead() once the keyboard is set up.
+ *
+ * Which key a reading means is looked up in a table per row, indexed by the
+ * top 6 bits of the reading. The tables are built at setup from the key
+ * thresholds saved in the EEPROM by the keyboard calibration program (V25N94),
+ * or from the default thresholds if the keyboard has not been calibrated.
+ *
  * This program is free software: you can redistribute it and/or modify
  * it under the terms of the GNU General Public License as published by
  * the Free Software Foundation, either version 3 of the License, or
@@ -26,25 +42,124 @@
  */
 #include <Wire.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
+#include <EEPROM.h>
+#include <avr/interrupt.h>
 
 /* Open DSKY headers */
 #include "Program.h"
 #include "Keyboard.h"
+#include "Scheduler.h"
 #include "main.h"
 
 //#define SERIAL_KEYBOARD
 //#define DEBUG
-static KeysEnum currentKey;
-static KeysEnum previousKey;
-static KeysEnum pressedKey;
 
-Thread* keyboardThread = new Thread();
-static KeysEnum ReadKeys(void);
+/* Number of key events that can be queued, must be a power of 2 */
+#define KEY_EVENT_QUEUE_SIZE 16U
+
+/* The first row of the keyboard is on A0 */
+#define KEYBOARD_FIRST_CHANNEL 0U
+
+/* The lookup tables have one entry for every 16 ADC counts, packed two to a
+   byte, each entry is the position of the key on the row */
+#define KEY_LOOKUP_SHIFT   4U
+#define KEY_LOOKUP_ENTRIES (1024U >> KEY_LOOKUP_SHIFT)
+#define KEY_LOOKUP_BYTES   (KEY_LOOKUP_ENTRIES / 2U)
+#define KEY_LOOKUP_NONE    0x0FU
+
+/* Where the key thresholds are kept in the EEPROM, after the launch time */
+#define KEY_CALIBRATION_ADDRESS 32U
+#define KEY_CALIBRATION_MAGIC   0x4BU
+
+/* The reading of a row when no key on it is pressed */
+#define KEY_ADC_IDLE 1023U
+
+/* Calibrated keys on a row have to be at least this far apart */
+#define KEY_CALIBRATION_MIN_GAP 32U
+
+/* Debounce counts, in scans of all of the rows, which take about 3ms */
+#define KEY_DEBOUNCE_MAX   30
+#define KEY_DEBOUNCE_PRESS 15
+#define KEY_DEBOUNCE_DROP  9
+
+/* Where Timer0 compare match A is in each Timer0 count, it only matters that
+   it is somewhere */
+#define KEYBOARD_TRIGGER_COUNT 128U
+
+/* The keys on each row, in order of the reading they give */
+static const uint8_t keyRowKeys[KEYBOARD_NUM_ROWS][KEYBOARD_ROW_KEYS] PROGMEM =
+{
+		{ KEY_VERB, KEY_PLUS,  KEY_7, KEY_8, KEY_9,       KEY_CLEAR,   KEY_NONE },
+		{ KEY_NOUN, KEY_MINUS, KEY_4, KEY_5, KEY_6,       KEY_PROCEED, KEY_ENTER },
+		{ KEY_0,    KEY_1,     KEY_2, KEY_3, KEY_RELEASE, KEY_RESET,   KEY_NONE }
+};
+
+/* Each key pulls its row down to a different voltage, the key pressed is the
+   first one whose threshold the reading is below. A threshold of 0 means
+   there is no key in that position. */
+typedef struct KEY_CALIBRATION_STRUCT
+{
+		uint8_t Magic;
+		uint16_t Below[KEYBOARD_NUM_ROWS][KEYBOARD_ROW_KEYS];
+		uint8_t Checksum;  /* makes the bytes of the struct add up to 0 */
+}KeyCalibrationStruct;
+
+static const KeyCalibrationStruct keyDefaultCalibration PROGMEM =
+{
+		KEY_CALIBRATION_MAGIC,
+		{
+				{ 225U, 370U, 510U, 650U, 790U, 930U, 0U },
+				{ 200U, 330U, 455U, 577U, 700U, 823U, 930U },
+				{ 225U, 370U, 510U, 650U, 790U, 930U, 0U }
+		},
+		0U
+};
+
+/* The lookup tables are not used while the keyboard is being calibrated, so
+   the readings of each key are kept in the same place */
+static union
+{
+		uint8_t Lookup[KEYBOARD_NUM_ROWS][KEY_LOOKUP_BYTES];
+		uint16_t Readings[KEYBOARD_NUM_ROWS][KEYBOARD_ROW_KEYS];
+}keyTables;
+
+static volatile bool keyCalibrating = false;
+static volatile uint16_t keyRowReading[KEYBOARD_NUM_ROWS];
+
+static volatile KeysEnum pressedKey;
+
+/* What is known about the key being held, only used by the producer */
+static KeysEnum pressedChord = KEY_NONE;
+static uint32_t pressedTime;       /* millis() when pressedKey was first seen */
+static uint32_t pressedRepeatTime; /* millis() when the next KEY_REPEAT is due */
+static bool pressedLong;           /* KEY_LONG_PRESS has been sent */
+static bool pressedChordLatched;   /* a chord was held, ignore keys until all are let go of */
+
+/* Auto repeat starts keyRepeatDelay ms after a key is pressed, and then sends
+   a KEY_REPEAT every keyRepeatRate ms, a rate of 0 turns it off */
+static volatile uint16_t keyRepeatDelay = KEY_REPEAT_DELAY_MS;
+static volatile uint16_t keyRepeatRate = KEY_REPEAT_RATE_MS;
+
+/* The key event queue is a single producer single consumer ring buffer. The
+   head is only written by the producer and the tail only by the consumer, both
+   are single bytes so they can be updated without disabling interrupts. */
+static volatile KeyEventStruct keyEventQueue[KEY_EVENT_QUEUE_SIZE];
+static volatile uint8_t keyEventHead = 0U;
+static volatile uint8_t keyEventTail = 0U;
+
+SchedulerThread* keyboardThread = new SchedulerThread();
+static void SetPressedKey(KeysEnum key, KeysEnum chord, uint32_t seen);
+static void PutKeyEvent(KeysEnum key, KeyEventTypeEnum type, KeysEnum chord, uint32_t now);
+static void KeyboardLoadCalibration(void);
+static void KeyboardBuildLookup(const KeyCalibrationStruct* calibration);
+static uint8_t KeyboardCalibrationSum(const KeyCalibrationStruct* calibration);
 
 #ifdef SERIAL_KEYBOARD
 static void ReadSerialKeys(void);
+#else
+static KeysEnum DecodeRow(uint8_t row, uint16_t value);
+static void DebounceKey(KeysEnum key, KeysEnum chord);
 #endif
 
 /**
@@ -58,238 +173,547 @@ void KeyboardSetup(void)
 		pinMode(A1, INPUT);
 		pinMode(A2, INPUT);
 
+		pressedKey  = KEY_NONE;
+		KeyboardLoadCalibration();
+
+#ifdef SERIAL_KEYBOARD
 		keyboardThread->onRun(KeyboardTask);
 		keyboardThread->setInterval(10);
 		controll.add(keyboardThread);
-
-		currentKey = KEY_NONE;
-		previousKey = KEY_NONE;
-		pressedKey  = KEY_NONE;
+#else
+		/* The rows are only read by the ADC, so turn off their digital inputs */
+		DIDR0 |= _BV(ADC0D) | _BV(ADC1D) | _BV(ADC2D);
+
+		/* AVcc reference, as analogRead() uses, starting on the first row */
+		ADMUX = _BV(REFS0) | KEYBOARD_FIRST_CHANNEL;
+
+		/* Start a conversion on Timer0 compare match A, the prescaler is left
+		   as the Arduino core set it */
+		OCR0A = KEYBOARD_TRIGGER_COUNT;
+		ADCSRB = _BV(ADTS1) | _BV(ADTS0);
+		TIFR0 = _BV(OCF0A);
+		ADCSRA |= _BV(ADEN) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE);
+#endif
 }
 
 /**
  * KeyboardTask
  *
- * Read and debounce the current key, this task gets run really often but
+ * Reads keys from the serial port when SERIAL_KEYBOARD is defined, the
+ * physical keyboard is read by the ADC interrupt.
  */
 void KeyboardTask(void)
 {
-		static int8_t currentKeyCount = 0;
-		previousKey = currentKey;
-
 #ifdef SERIAL_KEYBOARD
 		ReadSerialKeys();
-#else
-		currentKey = ReadKeys();
+#endif
+}
+
+
+#ifndef SERIAL_KEYBOARD
+/**
+ * ADC_vect
+ *
+ * Runs when a row has been read. The rows are read in turn, the first row
+ * with a key pressed gives the key and the second gives the chord, any more
+ * are ignored. Only one key on a row can be read at a time. Once every row
+ * has been read, the keys are debounced.
+ */
+ISR(ADC_vect)
+{
+		static uint8_t row = 0U;
+		static KeysEnum scanKey = KEY_NONE;
+		static KeysEnum scanChord = KEY_NONE;
+		uint16_t value = ADC;
+
+		/* The conversion is started by the compare match flag going high, so
+		   clear it ready for the next one */
+		TIFR0 = _BV(OCF0A);
 
-/* debounce the key reading */
-		if(previousKey != currentKey)
+		if(keyCalibrating)
 		{
-				if(currentKeyCount > 0)
-				{
-						currentKeyCount-=3;
-				}
+				/* the calibration program wants the raw readings */
+				keyRowReading[row] = value;
 		}
 		else
 		{
-				if(currentKeyCount < 10)
+				KeysEnum rowKey = DecodeRow(row, value);
+
+				if(scanKey == KEY_NONE)
 				{
-						currentKeyCount++;
+						scanKey = rowKey;
 				}
-				if(currentKeyCount > 5)
+				else if(scanChord == KEY_NONE)
 				{
-						pressedKey = currentKey;
+						scanChord = rowKey;
 				}
+		}
 
+		row++;
+		if(row >= KEYBOARD_NUM_ROWS)
+		{
+				row = 0U;
+				if(!keyCalibrating)
+				{
+						DebounceKey(scanKey, scanChord);
+				}
+				scanKey = KEY_NONE;
+				scanChord = KEY_NONE;
 		}
-#endif
+
+		/* the next conversion is a whole Timer0 count away, so the channel can
+		   be changed now */
+		ADMUX = (uint8_t)((ADMUX & 0xF0U) | (KEYBOARD_FIRST_CHANNEL + row));
 }
 
+
 /**
- * GetPressedKey
+ * DecodeRow
  *
- * @return  returns the currently pressed key
+ * Works out which key on a row is pressed from its ADC reading.
+ * @param  row   row of the keyboard, 0 to KEYBOARD_NUM_ROWS - 1
+ * @param  value ADC reading of the row
+ * @return       the pressed key, KEY_NONE if no key on the row is pressed
  */
-KeysEnum GetPressedKey(void)
+static KeysEnum DecodeRow(uint8_t row, uint16_t value)
 {
-		return pressedKey;
+		uint8_t entry = (uint8_t)(value >> KEY_LOOKUP_SHIFT);
+		uint8_t position = keyTables.Lookup[row][entry >> 1];
+
+		position = (entry & 1U) ? (position >> 4) : (position & 0x0FU);
+		return (position == KEY_LOOKUP_NONE) ? KEY_NONE : (KeysEnum)pgm_read_byte(&keyRowKeys[row][position]);
 }
 
+
 /**
- * ReadKeys
+ * DebounceKey
  *
- * Read the analog ports and work out which keys are pressed. NKRO is not
- * supported, instead first key wins.
- * @return  the pressed key
+ * Debounces the keys read by a scan of all of the rows. The keys have to be
+ * seen for more than KEY_DEBOUNCE_PRESS scans in a row before they are
+ * accepted, and each scan that sees something else takes them further away.
+ * @param key   key seen by the scan, KEY_NONE if no key is pressed
+ * @param chord key seen on a later row, KEY_NONE if there isn't one
  */
-static KeysEnum ReadKeys(void)
+static void DebounceKey(KeysEnum key, KeysEnum chord)
 {
-		int value_row1 = analogRead(A0);
-		int value_row2; /* do this later */
-		int value_row3; /* do this later */
+		static KeysEnum previousKey = KEY_NONE;
+		static KeysEnum previousChord = KEY_NONE;
+		static int8_t currentKeyCount = 0;
+		static uint32_t seenTime = 0UL;
 
-		if (value_row1 < 225)
+		if((previousKey != key) || (previousChord != chord))
 		{
-#ifdef DEBUG
-				Serial.println("Verb");
-#endif
-				return KEY_VERB;
-		}
-		else if (value_row1 < 370)
-		{
-#ifdef DEBUG
-				Serial.println("+");
-#endif
-				return KEY_PLUS;
-		}
-		else if (value_row1 < 510)
-		{
-#ifdef DEBUG
-				Serial.println("7");
-#endif
-				return KEY_7;
-		}
-		else if (value_row1 < 650)
-		{
-#ifdef DEBUG
-				Serial.println("8");
-#endif
-				return KEY_8;
+				seenTime = millis();
+				if(currentKeyCount > 0)
+				{
+						currentKeyCount -= KEY_DEBOUNCE_DROP;
+				}
 		}
-		else if (value_row1 < 790)
+		else
 		{
-#ifdef DEBUG
-				Serial.println("9");
-#endif
-				return KEY_9;
+				if(currentKeyCount < KEY_DEBOUNCE_MAX)
+				{
+						currentKeyCount++;
+				}
+				if(currentKeyCount > KEY_DEBOUNCE_PRESS)
+				{
+						SetPressedKey(key, chord, seenTime);
+				}
 		}
-		else if (value_row1 < 930)
-		{
-#ifdef DEBUG
-				Serial.println("Clear");
+		previousKey = key;
+		previousChord = chord;
+}
 #endif
-				return KEY_CLEAR;
-		}
-		else
+
+/**
+ * KeyboardLoadCalibration
+ *
+ * Builds the lookup tables from the key thresholds in the EEPROM, or from the
+ * default thresholds if the EEPROM doesn't hold any.
+ */
+static void KeyboardLoadCalibration(void)
+{
+		KeyCalibrationStruct calibration;
+
+		EEPROM.get(KEY_CALIBRATION_ADDRESS, calibration);
+		if((calibration.Magic != KEY_CALIBRATION_MAGIC) || (KeyboardCalibrationSum(&calibration) != 0U))
 		{
-				/* no row 1 pressed */
+				memcpy_P(&calibration, &keyDefaultCalibration, sizeof(calibration));
 		}
-		value_row2 = analogRead(A1);
+		KeyboardBuildLookup(&calibration);
+}
 
 
-		if (value_row2 < 200)
+/**
+ * KeyboardBuildLookup
+ *
+ * Fills in the lookup tables from a set of key thresholds. Each entry covers
+ * 16 ADC counts and gets the key whose range the middle of it falls in.
+ * @param calibration key thresholds to use
+ */
+static void KeyboardBuildLookup(const KeyCalibrationStruct* calibration)
+{
+		for(uint8_t row = 0U; row < KEYBOARD_NUM_ROWS; row++)
 		{
-#ifdef DEBUG
-				Serial.println("Noun");
-#endif
-				return KEY_NOUN;
+				for(uint8_t entry = 0U; entry < KEY_LOOKUP_ENTRIES; entry++)
+				{
+						uint16_t value = ((uint16_t)entry << KEY_LOOKUP_SHIFT) + (1U << (KEY_LOOKUP_SHIFT - 1U));
+						uint8_t position;
+
+						for(position = 0U; position < KEYBOARD_ROW_KEYS; position++)
+						{
+								if(value < calibration->Below[row][position])
+								{
+										break;
+								}
+						}
+						if(position >= KEYBOARD_ROW_KEYS)
+						{
+								position = KEY_LOOKUP_NONE;
+						}
+
+						if(entry & 1U)
+						{
+								keyTables.Lookup[row][entry >> 1] = (uint8_t)((keyTables.Lookup[row][entry >> 1] & 0x0FU) | (position << 4));
+						}
+						else
+						{
+								keyTables.Lookup[row][entry >> 1] = position;
+						}
+				}
 		}
-		else if (value_row2 < 330)
+}
+
+
+/**
+ * KeyboardCalibrationSum
+ *
+ * Adds up all of the bytes of a set of key thresholds, including its
+ * checksum, a good set adds up to 0.
+ * @param  calibration key thresholds to add up
+ * @return             the sum
+ */
+static uint8_t KeyboardCalibrationSum(const KeyCalibrationStruct* calibration)
+{
+		const uint8_t* bytePtr = (const uint8_t*)calibration;
+		uint8_t sum = 0U;
+
+		for(uint8_t idx = 0U; idx < sizeof(KeyCalibrationStruct); idx++)
 		{
-#ifdef DEBUG
-				Serial.println("-");
-#endif
-				return KEY_MINUS;
+				sum += bytePtr[idx];
 		}
-		else if (value_row2 < 455)
+		return sum;
+}
+
+
+/**
+ * KeyboardRowKey
+ *
+ * Gets the key in a position on a row.
+ * @param  row      row of the keyboard, 0 to KEYBOARD_NUM_ROWS - 1
+ * @param  position position of the key on the row, 0 to KEYBOARD_ROW_KEYS - 1
+ * @return          the key, KEY_NONE if there isn't a key there
+ */
+KeysEnum KeyboardRowKey(uint8_t row, uint8_t position)
+{
+		return (KeysEnum)pgm_read_byte(&keyRowKeys[row][position]);
+}
+
+
+/**
+ * KeyboardCalibrateStart
+ *
+ * Stops the keyboard decoding keys, so that the calibration program can read
+ * the rows with KeyboardCalibrateRead. No key events are made until
+ * KeyboardCalibrateFinish or KeyboardCalibrateCancel is called.
+ * @return true if the keyboard can be calibrated, it can't be when keys come
+ *         from the serial port
+ */
+bool KeyboardCalibrateStart(void)
+{
+#ifdef SERIAL_KEYBOARD
+		return false;
+#else
+		for(uint8_t row = 0U; row < KEYBOARD_NUM_ROWS; row++)
 		{
-#ifdef DEBUG
-				Serial.println("4");
-#endif
-				return KEY_4;
+				keyRowReading[row] = KEY_ADC_IDLE;
 		}
-		else if (value_row2 < 577)
-		{
-#ifdef DEBUG
-				Serial.println("5");
+		keyCalibrating = true;
+		memset(keyTables.Readings, 0, sizeof(keyTables.Readings));
+		return true;
 #endif
-				return KEY_5;
-		}
-		else if (value_row2 < 700)
+}
+
+
+/**
+ * KeyboardCalibrateRead
+ *
+ * Gets the latest reading of a row while the keyboard is being calibrated.
+ * @param  row row of the keyboard, 0 to KEYBOARD_NUM_ROWS - 1
+ * @return     ADC reading of the row
+ */
+uint16_t KeyboardCalibrateRead(uint8_t row)
+{
+		uint16_t value;
+
+		noInterrupts();
+		value = keyRowReading[row];
+		interrupts();
+		return value;
+}
+
+
+/**
+ * KeyboardCalibrateKey
+ *
+ * Records the reading a key gives while the keyboard is being calibrated.
+ * @param row      row of the keyboard, 0 to KEYBOARD_NUM_ROWS - 1
+ * @param position position of the key on the row, 0 to KEYBOARD_ROW_KEYS - 1
+ * @param value    ADC reading of the row with the key pressed
+ */
+void KeyboardCalibrateKey(uint8_t row, uint8_t position, uint16_t value)
+{
+		if(keyCalibrating)
 		{
-#ifdef DEBUG
-				Serial.println("6");
-#endif
-				return KEY_6;
+				keyTables.Readings[row][position] = value;
 		}
-		else if (value_row2 < 823)
+}
+
+
+/**
+ * KeyboardCalibrateFinish
+ *
+ * Works out the key thresholds from the recorded readings, halfway between
+ * each key and the next, saves them to the EEPROM and starts decoding keys
+ * with them. If the readings are not in order, or too close together, the
+ * thresholds that were in use before are kept.
+ * @return true if the new thresholds were saved
+ */
+bool KeyboardCalibrateFinish(void)
+{
+		KeyCalibrationStruct calibration;
+		bool good = keyCalibrating;
+
+		calibration.Magic = KEY_CALIBRATION_MAGIC;
+		for(uint8_t row = 0U; row < KEYBOARD_NUM_ROWS; row++)
 		{
-#ifdef DEBUG
-				Serial.println("Proceed");
-#endif
-				return KEY_PROCEED;
+				for(uint8_t position = 0U; position < KEYBOARD_ROW_KEYS; position++)
+				{
+						uint16_t value = keyTables.Readings[row][position];
+						uint16_t next = KEY_ADC_IDLE;
+
+						if(KeyboardRowKey(row, position) == KEY_NONE)
+						{
+								calibration.Below[row][position] = 0U;
+								continue;
+						}
+						if(((position + 1U) < KEYBOARD_ROW_KEYS) && (KeyboardRowKey(row, position + 1U) != KEY_NONE))
+						{
+								next = keyTables.Readings[row][position + 1U];
+						}
+						if((next < value) || ((next - value) < KEY_CALIBRATION_MIN_GAP))
+						{
+								good = false;
+						}
+						calibration.Below[row][position] = (uint16_t)((value + next) / 2U);
+				}
 		}
-		else if (value_row2 < 930)
+
+		if(good)
 		{
-#ifdef DEBUG
-				Serial.println("Enter");
-#endif
-				return KEY_ENTER;
+				calibration.Checksum = 0U;
+				calibration.Checksum = (uint8_t)(0U - KeyboardCalibrationSum(&calibration));
+				EEPROM.put(KEY_CALIBRATION_ADDRESS, calibration);
 		}
-		else
+		KeyboardCalibrateCancel();
+		return good;
+}
+
+
+/**
+ * KeyboardCalibrateCancel
+ *
+ * Stops calibrating the keyboard, and starts decoding keys again with the
+ * thresholds in the EEPROM.
+ */
+void KeyboardCalibrateCancel(void)
+{
+		if(keyCalibrating)
 		{
-				/* no row 2 pressed */
+				KeyboardLoadCalibration();
+				keyCalibrating = false;
 		}
+}
+
+
+/**
+ * GetPressedKey
+ *
+ * @return  returns the currently pressed key
+ */
+KeysEnum GetPressedKey(void)
+{
+		return pressedKey;
+}
+
 
+/**
+ * KeyboardGetEvent
+ *
+ * Takes the oldest key event out of the key event queue.
+ * @param  event structure to fill with the key event
+ * @return       true if an event was taken from the queue, false if it is empty
+ */
+bool KeyboardGetEvent(KeyEventStruct* event)
+{
+		uint8_t tail = keyEventTail;
 
-		value_row3 = analogRead(A2);
-		if (value_row3 < 225)
+		if(tail == keyEventHead)
 		{
-#ifdef DEBUG
-				Serial.println("0");
-#endif
-				return KEY_0;
+				return false;
 		}
-		else if (value_row3 < 370)
+
+		event->Time = keyEventQueue[tail].Time;
+		event->Duration = keyEventQueue[tail].Duration;
+		event->Key = keyEventQueue[tail].Key;
+		event->Type = keyEventQueue[tail].Type;
+		event->Chord = keyEventQueue[tail].Chord;
+		keyEventTail = (tail + 1U) & (KEY_EVENT_QUEUE_SIZE - 1U);
+		return true;
+}
+
+
+/**
+ * KeyboardEventPending
+ *
+ * @return  true if there are key events in the queue waiting to be taken
+ */
+bool KeyboardEventPending(void)
+{
+		return (keyEventTail != keyEventHead);
+}
+
+
+/**
+ * KeyboardSetAutoRepeat
+ *
+ * Sets up auto repeat, while a key is held a KEY_REPEAT event is sent for it
+ * every rateMs, starting delayMs after it was pressed. Until this is called
+ * it uses KEY_REPEAT_DELAY_MS and KEY_REPEAT_RATE_MS.
+ * @param delayMs milliseconds from a key being pressed to the first repeat
+ * @param rateMs  milliseconds between repeats, 0 turns auto repeat off
+ */
+void KeyboardSetAutoRepeat(uint16_t delayMs, uint16_t rateMs)
+{
+		noInterrupts();
+		keyRepeatDelay = delayMs;
+		keyRepeatRate = rateMs;
+		interrupts();
+}
+
+
+/**
+ * PutKeyEvent
+ *
+ * Adds a key event to the key event queue, if the queue is full the event is
+ * dropped. With the physical keyboard this is called from the ADC interrupt,
+ * which is the only producer.
+ * @param key   the key the event is for
+ * @param type  KeyEventTypeEnum with what happened to the key
+ * @param chord the other key of a KEY_CHORD, KEY_NONE for other events
+ * @param now   millis() when the event happened
+ */
+static void PutKeyEvent(KeysEnum key, KeyEventTypeEnum type, KeysEnum chord, uint32_t now)
+{
+		uint8_t head = keyEventHead;
+		uint8_t nextHead = (head + 1U) & (KEY_EVENT_QUEUE_SIZE - 1U);
+		unsigned long duration = now - pressedTime;
+
+		if(nextHead != keyEventTail)
 		{
-#ifdef DEBUG
-				Serial.println("1");
-#endif
-				return KEY_1;
+				keyEventQueue[head].Time = now;
+				keyEventQueue[head].Duration = (uint16_t)min(duration, 0xFFFFUL);
+				keyEventQueue[head].Key = (uint8_t)key;
+				keyEventQueue[head].Type = (uint8_t)type;
+				keyEventQueue[head].Chord = (uint8_t)chord;
+				keyEventHead = nextHead;
 		}
+}
+
+
+/**
+ * SetPressedKey
+ *
+ * Updates the debounced keys, and queues the release and press edges if they
+ * have changed. While the same key is held this sends its KEY_LONG_PRESS and
+ * KEY_REPEAT events, so it needs calling often. Once a chord has been held no
+ * more events are sent until every key has been let go of, so that letting go
+ * of one half of a chord doesn't look like pressing the other.
+ * @param key   the newly debounced key, KEY_NONE if no key is pressed
+ * @param chord a second debounced key on another row, KEY_NONE if there isn't one
+ * @param seen  millis() when the keys were first seen, before debouncing
+ */
+static void SetPressedKey(KeysEnum key, KeysEnum chord, uint32_t seen)
+{
+		uint32_t now = millis();
 
-		else if (value_row3 < 510)
+		/* keep the key that was held first as the key, whichever row it is on */
+		if((chord != KEY_NONE) && (chord == pressedKey))
 		{
-#ifdef DEBUG
-				Serial.println("2");
-#endif
-				return KEY_2;
+				chord = key;
+				key = pressedKey;
 		}
-		else if (value_row3 < 650)
+
+		if(pressedChordLatched)
 		{
-#ifdef DEBUG
-				Serial.println("3");
-#endif
-				return KEY_3;
+				if(key == KEY_NONE)
+				{
+						pressedChordLatched = false;
+				}
+				pressedChord = chord;
+				return;
 		}
-		else if (value_row3 < 790)
+
+		if(key != pressedKey)
 		{
-#ifdef DEBUG
-				Serial.println("Releae");
-#endif
-				return KEY_RELEASE;
+				if(pressedKey != KEY_NONE)
+				{
+						PutKeyEvent(pressedKey, KEY_RELEASED, KEY_NONE, now);
+				}
+				pressedTime = seen;
+				if(key != KEY_NONE)
+				{
+						PutKeyEvent(key, KEY_PRESSED, KEY_NONE, now);
+				}
+				pressedKey = key;
+				pressedChord = KEY_NONE;
+				pressedRepeatTime = now + keyRepeatDelay;
+				pressedLong = false;
 		}
-		else if (value_row3 < 930)
+		else if(key != KEY_NONE)
 		{
-#ifdef DEBUG
-				Serial.println("Reset");
-#endif
-				return KEY_RESET;
+				if(!pressedLong && ((now - pressedTime) >= KEY_LONG_PRESS_MS))
+				{
+						PutKeyEvent(key, KEY_LONG_PRESS, KEY_NONE, now);
+						pressedLong = true;
+				}
+				if((keyRepeatRate != 0U) && ((int32_t)(now - pressedRepeatTime) >= 0))
+				{
+						PutKeyEvent(key, KEY_REPEAT, KEY_NONE, now);
+						pressedRepeatTime += keyRepeatRate;
+				}
 		}
-		else
+
+		if((key != KEY_NONE) && (chord != KEY_NONE) && (chord != pressedChord))
 		{
-			#ifdef DEBUG
-				Serial.print(value_row1);
-				Serial.print("\t");
-				Serial.print(value_row2);
-				Serial.print("\t");
-				Serial.println(value_row3);
-			#endif
-				return KEY_NONE;
+				PutKeyEvent(key, KEY_CHORD, chord, now);
+				PutKeyEvent(key, KEY_RELEASED, KEY_NONE, now);
+				pressedKey = KEY_NONE;
+				pressedChordLatched = true;
 		}
+		pressedChord = chord;
 }
 
-
 #ifdef SERIAL_KEYBOARD
 /**
  * ReadSerialKeys
@@ -298,6 +722,7 @@ static KeysEnum ReadKeys(void)
  */
 static void ReadSerialKeys(void)
 {
+		KeysEnum key;
 
 		if(Serial.available() > 0)
 		{
@@ -306,93 +731,97 @@ static void ReadSerialKeys(void)
 				{
 				case 'V':
 				case 'v':
-						pressedKey = KEY_VERB;
+						key = KEY_VERB;
 						break;
 
 				case 'n':
 				case 'N':
-						pressedKey = KEY_NOUN;
+						key = KEY_NOUN;
 						break;
 
 
 				case '+':
-						pressedKey = KEY_PLUS;
+						key = KEY_PLUS;
 						break;
 
 				case '-':
-						pressedKey = KEY_MINUS;
+						key = KEY_MINUS;
 						break;
 
 				case '0':
-						pressedKey = KEY_0;
+						key = KEY_0;
 						break;
 
 				case '1':
-						pressedKey = KEY_1;
+						key = KEY_1;
 						break;
 
 				case '2':
-						pressedKey = KEY_2;
+						key = KEY_2;
 						break;
 
 				case '3':
-						pressedKey = KEY_3;
+						key = KEY_3;
 						break;
 
 				case '4':
-						pressedKey = KEY_4;
+						key = KEY_4;
 						break;
 
 				case '5':
-						pressedKey = KEY_5;
+						key = KEY_5;
 						break;
 
 				case '6':
-						pressedKey = KEY_6;
+						key = KEY_6;
 						break;
 
 				case '7':
-						pressedKey = KEY_7;
+						key = KEY_7;
 						break;
 
 				case '8':
-						pressedKey = KEY_8;
+						key = KEY_8;
 						break;
 
 				case '9':
-						pressedKey = KEY_9;
+						key = KEY_9;
 						break;
 
 				case '\r':
 				case ' ':
-						pressedKey = KEY_ENTER;
+						key = KEY_ENTER;
 						break;
 
 				case 'd':
-						pressedKey = KEY_CLEAR;
+						key = KEY_CLEAR;
 						break;
 
 				case 'p':
-						pressedKey = KEY_PROCEED;
+						key = KEY_PROCEED;
 						break;
 
 				case 'r':
-						pressedKey = KEY_RELEASE;
+						key = KEY_RELEASE;
 						break;
 
 				case 't':
-						pressedKey = KEY_RESET;
+						key = KEY_RESET;
 						break;
 
 				default:
-						pressedKey = KEY_NONE;
+						key = KEY_NONE;
 						break;
 				}
 		}
 		else
 		{
-				pressedKey = KEY_NONE;
+				key = KEY_NONE;
 		}
+		/* release the previous key first, so that repeated characters give
+		   repeated key presses */
+		SetPressedKey(KEY_NONE, KEY_NONE, millis());
+		SetPressedKey(key, KEY_NONE, millis());
 
 }
 #endif
@@ -1,6 +1,17 @@
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
+/* The keyboard has three rows of up to seven keys */
+#define KEYBOARD_NUM_ROWS 3U
+#define KEYBOARD_ROW_KEYS 7U
+
+/* How long a key has to be held to send a KEY_LONG_PRESS */
+#define KEY_LONG_PRESS_MS 1000U
+
+/* Auto repeat to start with, until KeyboardSetAutoRepeat changes it */
+#define KEY_REPEAT_DELAY_MS 500U
+#define KEY_REPEAT_RATE_MS  150U
+
 typedef enum KEYS_ENUM
 {
 		KEY_0 = 0,
@@ -28,7 +39,37 @@ typedef enum KEYS_ENUM
 }KeysEnum;
 
 
+typedef enum KEY_EVENT_TYPE_ENUM
+{
+		KEY_PRESSED,
+		KEY_RELEASED,
+		KEY_REPEAT,      /* the key is still held, sent when auto repeat is on */
+		KEY_LONG_PRESS,  /* the key has been held for KEY_LONG_PRESS_MS */
+		KEY_CHORD,       /* Chord has been pressed while Key is held */
+		NUM_KEY_EVENT_TYPES
+}KeyEventTypeEnum;
+
+typedef struct KEY_EVENT_STRUCT
+{
+		uint32_t Time;      /* millis() when the debounced edge was seen */
+		uint16_t Duration;  /* milliseconds since Key was first seen, for KEY_PRESSED
+		                       this is how long it took to debounce */
+		uint8_t Key;        /* KeysEnum */
+		uint8_t Type;       /* KeyEventTypeEnum */
+		uint8_t Chord;      /* KeysEnum of the other key of a KEY_CHORD, else KEY_NONE */
+}KeyEventStruct;
+
+
 extern void KeyboardSetup (void);
 extern void KeyboardTask(void);
 extern KeysEnum GetPressedKey(void);
+extern bool KeyboardGetEvent(KeyEventStruct* event);
+extern bool KeyboardEventPending(void);
+extern void KeyboardSetAutoRepeat(uint16_t delayMs, uint16_t rateMs);
+extern KeysEnum KeyboardRowKey(uint8_t row, uint8_t position);
+extern bool KeyboardCalibrateStart(void);
+extern uint16_t KeyboardCalibrateRead(uint8_t row);
+extern void KeyboardCalibrateKey(uint8_t row, uint8_t position, uint16_t value);
+extern bool KeyboardCalibrateFinish(void);
+extern void KeyboardCalibrateCancel(void);
 #endif
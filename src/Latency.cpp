@@ -0,0 +1,257 @@
+/*
+ * Latency.cpp
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * Measures how long it takes from a key being pressed to the display showing
+ * it. One key press at a time is followed through the keyboard, ProgramTask
+ * and the display driver, with a timestamp taken at each LatencyStageEnum.
+ * When it reaches the display, the time it spent between each stage, and in
+ * total, is counted in a histogram. A key pressed before the last one reached
+ * the display starts again with the new key.
+ *
+ * The keyboard only knows the time in milliseconds, so the time spent
+ * debouncing and waiting in the queue is only as good as that. Everything
+ * after that is timed in microseconds.
+ *
+ * Comment out #define LATENCY_STATS to save the RAM, everything will then
+ * read as 0.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <Arduino.h>
+
+/* Open DSKY headers */
+#include "Keyboard.h"
+#include "Latency.h"
+
+#define LATENCY_STATS
+
+#ifdef LATENCY_STATS
+/* Histogram of the time taken to reach each stage from the one before it.
+   LATENCY_DETECTED has no stage before it, so it holds the total instead */
+static uint16_t latencyHistogram[NUM_LATENCY_STAGES][LATENCY_NUM_BUCKETS];
+static unsigned long latencyTime[NUM_LATENCY_STAGES];  /* micros() at each stage */
+static uint8_t latencyNextStage = NUM_LATENCY_STAGES;  /* NUM_LATENCY_STAGES when nothing is being followed */
+static uint16_t latencyCount = 0U;
+static unsigned long latencyLast = 0UL;
+static unsigned long latencyWorst = 0UL;
+
+static void LatencyRecord(void);
+static uint8_t LatencyBucket(unsigned long time);
+#endif
+
+
+/**
+ * LatencyKeyConsumed
+ *
+ * Starts following a key press, call when ProgramTask takes it from the key
+ * event queue. The times it was seen and debounced are worked out from the
+ * event.
+ * @param event the KEY_PRESSED event
+ */
+void LatencyKeyConsumed(const KeyEventStruct* event)
+{
+#ifdef LATENCY_STATS
+		unsigned long now = micros();
+		unsigned long queued = (millis() - event->Time) * 1000UL;
+
+		latencyTime[LATENCY_CONSUMED] = now;
+		latencyTime[LATENCY_DEBOUNCED] = now - queued;
+		latencyTime[LATENCY_DETECTED] = now - queued - ((unsigned long)event->Duration * 1000UL);
+		latencyNextStage = LATENCY_HANDLED;
+#endif
+}
+
+
+/**
+ * LatencyMark
+ *
+ * Marks that the key press being followed has reached a stage. Marks for
+ * any other stage than the next one are ignored, so this can be called every
+ * time the code passes the stage, whether a key press is being followed or not.
+ * @param stage the stage that has been reached
+ */
+void LatencyMark(LatencyStageEnum stage)
+{
+#ifdef LATENCY_STATS
+		if(stage == latencyNextStage)
+		{
+				latencyTime[stage] = micros();
+				latencyNextStage++;
+				if(latencyNextStage >= NUM_LATENCY_STAGES)
+				{
+						LatencyRecord();
+				}
+		}
+#endif
+}
+
+
+/**
+ * LatencyCount
+ *
+ * @return  the number of key presses that have been followed to the display
+ */
+uint16_t LatencyCount(void)
+{
+#ifdef LATENCY_STATS
+		return latencyCount;
+#else
+		return 0U;
+#endif
+}
+
+
+/**
+ * LatencyLastMillis
+ *
+ * @return  milliseconds from the last key press to the display showing it
+ */
+uint16_t LatencyLastMillis(void)
+{
+#ifdef LATENCY_STATS
+		return (uint16_t)(latencyLast / 1000UL);
+#else
+		return 0U;
+#endif
+}
+
+
+/**
+ * LatencyWorstMillis
+ *
+ * @return  the most milliseconds any key press has taken to reach the display
+ */
+uint16_t LatencyWorstMillis(void)
+{
+#ifdef LATENCY_STATS
+		return (uint16_t)(latencyWorst / 1000UL);
+#else
+		return 0U;
+#endif
+}
+
+
+/**
+ * LatencyPercentileMillis
+ *
+ * Works out the time that a percentage of key presses reached the display
+ * within. It is only as good as the histogram, so the answer is the top of
+ * the bucket the percentile falls in, or the worst time if that is less.
+ * @param  percent percentile to work out, 1 to 100
+ * @return         the percentile in milliseconds
+ */
+uint16_t LatencyPercentileMillis(uint8_t percent)
+{
+#ifdef LATENCY_STATS
+		unsigned long wanted = (((unsigned long)latencyCount * percent) + 99UL) / 100UL;
+		unsigned long counted = 0UL;
+
+		for(uint8_t bucket = 0U; bucket < LATENCY_NUM_BUCKETS; bucket++)
+		{
+				counted += latencyHistogram[LATENCY_DETECTED][bucket];
+				if((counted >= wanted) && (counted > 0UL))
+				{
+						unsigned long top = LATENCY_FIRST_BUCKET_US << bucket;
+
+						return (uint16_t)(min(top, latencyWorst) / 1000UL);
+				}
+		}
+#endif
+		return 0U;
+}
+
+
+/**
+ * LatencyReport
+ *
+ * Prints the latency histograms to the serial port, one line per bucket
+ * with the top of the bucket in microseconds, then the number of key presses
+ * in it for the total and for each stage.
+ */
+void LatencyReport(void)
+{
+#ifdef LATENCY_STATS
+		Serial.println(F("us<\ttotal\tdebnce\tqueue\thandle\tcompose\twrite"));
+		for(uint8_t bucket = 0U; bucket < LATENCY_NUM_BUCKETS; bucket++)
+		{
+				if(bucket < (LATENCY_NUM_BUCKETS - 1U))
+				{
+						Serial.print(LATENCY_FIRST_BUCKET_US << bucket);
+				}
+				else
+				{
+						Serial.print(F("more"));
+				}
+				for(uint8_t stage = 0U; stage < NUM_LATENCY_STAGES; stage++)
+				{
+						Serial.print('\t');
+						Serial.print(latencyHistogram[stage][bucket]);
+				}
+				Serial.println();
+		}
+		Serial.print(F("presses "));
+		Serial.print(latencyCount);
+		Serial.print(F(" worst us "));
+		Serial.println(latencyWorst);
+#endif
+}
+
+
+#ifdef LATENCY_STATS
+/**
+ * LatencyRecord
+ *
+ * Counts the key press that has just reached the display in the histograms.
+ */
+static void LatencyRecord(void)
+{
+		unsigned long total = latencyTime[LATENCY_WRITTEN] - latencyTime[LATENCY_DETECTED];
+
+		/* stop counting rather than wrap round */
+		if(latencyCount < 0xFFFFU)
+		{
+				latencyCount++;
+				latencyHistogram[LATENCY_DETECTED][LatencyBucket(total)]++;
+				for(uint8_t stage = LATENCY_DEBOUNCED; stage < NUM_LATENCY_STAGES; stage++)
+				{
+						latencyHistogram[stage][LatencyBucket(latencyTime[stage] - latencyTime[stage - 1U])]++;
+				}
+		}
+		latencyLast = total;
+		latencyWorst = max(latencyWorst, total);
+}
+
+
+/**
+ * LatencyBucket
+ *
+ * @param  time a latency in microseconds
+ * @return      the histogram bucket it goes in
+ */
+static uint8_t LatencyBucket(unsigned long time)
+{
+		uint8_t bucket = 0U;
+
+		while((time >= (LATENCY_FIRST_BUCKET_US << bucket)) && (bucket < (LATENCY_NUM_BUCKETS - 1U)))
+		{
+				bucket++;
+		}
+		return bucket;
+}
+#endif
@@ -0,0 +1,52 @@
+/*
+ * Latency.h
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "Keyboard.h"
+
+/* The points a key press passes on its way to the display, in order */
+typedef enum LATENCY_STAGE_ENUM
+{
+		LATENCY_DETECTED,   /* the ADC first saw the key */
+		LATENCY_DEBOUNCED,  /* the key press event was queued */
+		LATENCY_CONSUMED,   /* ProgramTask took the event from the queue */
+		LATENCY_HANDLED,    /* the key has been given to the program */
+		LATENCY_COMPOSED,   /* the display thread has put the next frame together */
+		LATENCY_WRITTEN,    /* the changed rows have been sent to the MAX7219 */
+		NUM_LATENCY_STAGES
+}LatencyStageEnum;
+
+/* Latencies are counted in buckets that double in size, bucket 0 is under
+   LATENCY_FIRST_BUCKET_US and the last bucket has everything too big for the
+   one before it */
+#define LATENCY_NUM_BUCKETS     12U
+#define LATENCY_FIRST_BUCKET_US 128UL
+
+extern void LatencyKeyConsumed(const KeyEventStruct* event);
+extern void LatencyMark(LatencyStageEnum stage);
+extern uint16_t LatencyCount(void);
+extern uint16_t LatencyLastMillis(void);
+extern uint16_t LatencyWorstMillis(void);
+extern uint16_t LatencyPercentileMillis(uint8_t percent);
+extern void LatencyReport(void);
+#endif /* LATENCY_H */
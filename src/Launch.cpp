@@ -25,7 +25,6 @@
 
 #include <Wire.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 #include <EEPROM.h>
 
@@ -38,9 +37,11 @@
 #include "GPS.h"
 #include "Launch.h"
 #include "DiagnosticPrograms.h"
+#include "ThreadPool.h"
+#include "Scheduler.h"
 #include "main.h"
 
-static SevenSegmentDisplayStruct LaunchDisplayData;
+static SevenSegmentFrameStruct LaunchFrame;
 static RtcDateTime LaunchTime;
 static bool V37N02Foreground = false;
 static bool LaunchTrackPlayed = false;
@@ -48,9 +49,9 @@ Thread* V37N02Thread = NULL;
 Thread* V16N65Thread = NULL;
 
 
-SevenSegmentDisplayStruct* LaunchGetDisplayData(void)
+const SevenSegmentDisplayStruct* LaunchGetDisplayData(void)
 {
-		return &LaunchDisplayData;
+		return SevenSegmentFrontBuffer(&LaunchFrame);
 }
 
 
@@ -61,6 +62,7 @@ SevenSegmentDisplayStruct* LaunchGetDisplayData(void)
  */
 void V37N02ThreadCallback(void)
 {
+		SevenSegmentDisplayStruct* displayData;
 		static uint32_t lastMillis = 0;
 		static float velocity = 0.0;
 		static float accel = 0.0;
@@ -72,7 +74,7 @@ void V37N02ThreadCallback(void)
 		RtcDateTime NowTime = RTCDateTimeReturnNow();
 		ActionTime -= 10;
 
-
+		displayData = SevenSegmentBeginFrame(&LaunchFrame);
 		if(LaunchTime.TotalSeconds() > NowTime.TotalSeconds())
 		{
 #ifdef DEBUG
@@ -85,12 +87,12 @@ void V37N02ThreadCallback(void)
 				accel = 0.0;
 				if(V37N02Foreground)
 				{
-						LaunchDisplayData.Verb = 75;
-						LaunchDisplayData.Noun = 00;
-						LaunchDisplayData.Prog = 02;
-						LaunchDisplayData.R1 = (int32_t)ClockTime.Hour() * -1;
-						LaunchDisplayData.R2 = (int32_t)ClockTime.Minute()* -1;
-						LaunchDisplayData.R3 = (ClockTime.Second() * -100 ) + (((currMillis - lastMillis)/10)%100);
+						displayData->Verb = SEVEN_SEGMENT_PAIR(75);
+						displayData->Noun = SEVEN_SEGMENT_PAIR(00);
+						displayData->Prog = SEVEN_SEGMENT_PAIR(02);
+						SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)ClockTime.Hour() * -1, 0x3F);
+						SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)ClockTime.Minute()* -1, 0x3F);
+						SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (ClockTime.Second() * -100 ) + (((currMillis - lastMillis)/10)%100), 0x3F);
 				}
 
 				if((LaunchTime.TotalSeconds() - 6) == NowTime.TotalSeconds() )
@@ -146,20 +148,19 @@ void V37N02ThreadCallback(void)
 
 				if(V37N02Foreground)
 				{
-						LaunchDisplayData.R1 = (int32_t)velocity;
-						LaunchDisplayData.R2 = (int32_t)accel;
-						LaunchDisplayData.R3 = (int32_t)height;
-						LaunchDisplayData.Prog = 11;
-						LaunchDisplayData.Verb = 06;
-						LaunchDisplayData.Noun = 62;
+						SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)velocity, 0x3F);
+						SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)accel, 0x3F);
+						SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)height, 0x3F);
+						displayData->Prog = SEVEN_SEGMENT_PAIR(11);
+						displayData->Verb = SEVEN_SEGMENT_PAIR(06);
+						displayData->Noun = SEVEN_SEGMENT_PAIR(62);
+						displayData->Flags = 0U;
 				}
 
 		}
 		if(V37N02Foreground)
 		{
-				LaunchDisplayData.R1DigitShowMask = 0x3F;
-				LaunchDisplayData.R2DigitShowMask = 0x3F;
-				LaunchDisplayData.R3DigitShowMask = 0x3F;
+				SevenSegmentPublishFrame(&LaunchFrame);
 		}
 }
 
@@ -172,7 +173,12 @@ void V37N02ThreadCallback(void)
 ProgramRunStateEnum V37N02GiveData(uint8_t dataIdx,int32_t data)
 {
 		uint8_t* LauchTimeBytePtr = (uint8_t*)&LaunchTime;;
+		SevenSegmentDisplayStruct* displayData;
 
+		/* The time has been loaded, so stop flashing */
+		displayData = SevenSegmentBeginFrame(&LaunchFrame);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&LaunchFrame);
 
 		LaunchTime =  RTCDateTimeReturnNow();
 		LaunchTime += (uint32_t)(data);
@@ -204,6 +210,8 @@ ProgramRunStateEnum V37N02GiveData(uint8_t dataIdx,int32_t data)
 
 ProgramRunStateEnum V37N02Launch(ProgramCallStateEnum call)
 {
+		SevenSegmentDisplayStruct* displayData;
+
 		V37N02Foreground = false;
 		switch(call)
 		{
@@ -211,27 +219,25 @@ ProgramRunStateEnum V37N02Launch(ProgramCallStateEnum call)
 		case RESET_PROGRAM:
 		case BRING_PROGRAM_TO_FOREGROUND:
 				/* Clear out the display data ready for input */
-				LaunchDisplayData.R1 = 0;
-				LaunchDisplayData.R2 = 0;
-				LaunchDisplayData.R3 = 0;
-				LaunchDisplayData.Verb = 75;
-				LaunchDisplayData.Noun = 00;
-				LaunchDisplayData.Prog = 02;
-				LaunchDisplayData.R1DigitShowMask = 0x3F;
-				LaunchDisplayData.R2DigitShowMask = 0x3F;
-				LaunchDisplayData.R3DigitShowMask = 0x3F;
+				displayData = SevenSegmentBeginFrame(&LaunchFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, 0, 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, 0, 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, 0, 0x3F);
+				displayData->Verb = SEVEN_SEGMENT_PAIR(75);
+				displayData->Noun = SEVEN_SEGMENT_PAIR(00);
+				displayData->Prog = SEVEN_SEGMENT_PAIR(02);
+				/* flash VERB NOUN until the time to lift off is loaded */
+				displayData->Flags = SEVEN_SEGMENT_FLASH_VERB | SEVEN_SEGMENT_FLASH_NOUN;
+				SevenSegmentPublishFrame(&LaunchFrame);
 
 				V37N02Foreground = true;
 				/* Check if the thread already exists before we try to create it. */
 				if(V37N02Thread == NULL)
 				{
-						V37N02Thread = new Thread();
-						V37N02Thread->onRun(V37N02ThreadCallback);
-						V37N02Thread->setInterval(200);
-						controll.add(V37N02Thread);
+						V37N02Thread = ThreadPoolAcquire(V37N02ThreadCallback, 200);
 				}
 
-				return FOREGROUND;
+				return (V37N02Thread != NULL) ? FOREGROUND : NOT_RUNNING;
 				break;
 
 		case PAUSE_PROGRAM:
@@ -265,8 +271,7 @@ ProgramRunStateEnum V37N02Launch(ProgramCallStateEnum call)
 
 				if(V37N02Thread != NULL)
 				{
-						controll.remove(V37N02Thread);
-						delete[] V37N02Thread;
+						ThreadPoolRelease(V37N02Thread);
 						V37N02Thread = NULL;
 				}
 				return NOT_RUNNING;
@@ -278,6 +283,7 @@ ProgramRunStateEnum V37N02Launch(ProgramCallStateEnum call)
 
 void V16N65ThreadCallback(void)
 {
+		SevenSegmentDisplayStruct* displayData;
 		static uint32_t lastMillis = 0;
 		uint32_t currMillis = (uint32_t)millis();
 
@@ -287,18 +293,22 @@ void V16N65ThreadCallback(void)
 		if(ActionTime.TotalSeconds() <= NowTime.TotalSeconds())
 		{
 				RtcDateTime ClockTime = RtcDateTime( NowTime.TotalSeconds() - ActionTime.TotalSeconds());
-				LaunchDisplayData.R1 = ClockTime.Hour() * -1;
-				LaunchDisplayData.R2 = ClockTime.Minute()* -1;
-				LaunchDisplayData.R3 = (ClockTime.Second() * -100 ) + (((currMillis - lastMillis)/10)%100);
+				displayData = SevenSegmentBeginFrame(&LaunchFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, ClockTime.Hour() * -1, 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, ClockTime.Minute()* -1, 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (ClockTime.Second() * -100 ) + (((currMillis - lastMillis)/10)%100), 0x3F);
+				SevenSegmentPublishFrame(&LaunchFrame);
 
 
 		}
 		else
 		{
 				RtcDateTime ClockTime = RtcDateTime( NowTime.TotalSeconds() - ActionTime.TotalSeconds());
-				LaunchDisplayData.R1 = ClockTime.Hour();
-				LaunchDisplayData.R2 = ClockTime.Minute();
-				LaunchDisplayData.R3 = (ClockTime.Second() * 100 ) + (((currMillis - lastMillis)/10)%100);
+				displayData = SevenSegmentBeginFrame(&LaunchFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, ClockTime.Hour(), 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, ClockTime.Minute(), 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (ClockTime.Second() * 100 ) + (((currMillis - lastMillis)/10)%100), 0x3F);
+				SevenSegmentPublishFrame(&LaunchFrame);
 
 		}
 		lastMillis = currMillis;
@@ -307,6 +317,8 @@ void V16N65ThreadCallback(void)
 
 ProgramRunStateEnum V16N65Launch(ProgramCallStateEnum call)
 {
+		SevenSegmentDisplayStruct* displayData;
+
 		switch(call)
 		{
 		case START_PROGRAM:
@@ -316,25 +328,24 @@ ProgramRunStateEnum V16N65Launch(ProgramCallStateEnum call)
 
 
 				/* Clear out the display data ready for input */
-				LaunchDisplayData.R1 = 0;
-				LaunchDisplayData.R2 = 0;
-				LaunchDisplayData.R3 = 0;
-				LaunchDisplayData.Verb = 16;
-				LaunchDisplayData.Noun = 65;
-				LaunchDisplayData.R1DigitShowMask = 0x3F;
-				LaunchDisplayData.R2DigitShowMask = 0x3F;
-				LaunchDisplayData.R3DigitShowMask = 0x3F;
+				displayData = SevenSegmentBeginFrame(&LaunchFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, 0, 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, 0, 0x3F);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, 0, 0x3F);
+				displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+				displayData->Noun = SEVEN_SEGMENT_PAIR(65);
+				/* V37N02 shares the frame, don't keep its program or flashing */
+				displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+				displayData->Flags = 0U;
+				SevenSegmentPublishFrame(&LaunchFrame);
 
 				/* Check if the thread already exists before we try to create it. */
 				if(V16N65Thread == NULL)
 				{
-						V16N65Thread = new Thread();
-						V16N65Thread->onRun(V16N65ThreadCallback);
-						V16N65Thread->setInterval(100);
-						controll.add(V16N65Thread);
+						V16N65Thread = ThreadPoolAcquire(V16N65ThreadCallback, 100);
 				}
 				LaunchTrackPlayed = false;
-				return FOREGROUND;
+				return (V16N65Thread != NULL) ? FOREGROUND : NOT_RUNNING;
 				break;
 
 
@@ -345,8 +356,7 @@ ProgramRunStateEnum V16N65Launch(ProgramCallStateEnum call)
 		default:
 				if(V16N65Thread != NULL)
 				{
-						controll.remove(V16N65Thread);
-						delete[] V16N65Thread;
+						ThreadPoolRelease(V16N65Thread);
 						V16N65Thread = NULL;
 						return NOT_RUNNING;
 				}
@@ -25,7 +25,7 @@
 #ifndef LAUNCH_PROGRAM_H
 #define LAUNCH_PROGRAM_H
 
-extern SevenSegmentDisplayStruct* LaunchGetDisplayData(void);
+extern const SevenSegmentDisplayStruct* LaunchGetDisplayData(void);
 
 extern void V37N02ThreadCallback(void);
 extern void V16N65LaunchThreadCallback(void);
@@ -0,0 +1,132 @@
+/*
+ * Max7219.cpp
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * Driver for the chain of MAX7219s behind the 7 segment displays. LedControl
+ * uses digitalWrite and shiftOut, and sends a whole chain of NO-OPs for every
+ * register it writes on one device. This writes straight to PORTB, and writes
+ * the same register on every device in one frame, so updating one digit on
+ * all four displays takes one 64 bit frame instead of four.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <Arduino.h>
+#include <avr/io.h>
+
+/* Open DSKY headers */
+#include "Max7219.h"
+
+/* The MAX7219s are on the same pins that were given to LedControl(12,10,11,4),
+   which are all on PORTB. Setting and clearing single bits of PORTB compiles
+   to sbi/cbi, which can't be interrupted, so the other PORTB pins are safe. */
+#define MAX7219_DIN_BIT PB4  /* Arduino pin 12 */
+#define MAX7219_CLK_BIT PB2  /* Arduino pin 10 */
+#define MAX7219_CS_BIT  PB3  /* Arduino pin 11 */
+
+#define MAX7219_NUM_DIGITS 8U
+
+
+/**
+ * Max7219ShiftByte
+ *
+ * Clocks a byte out to the chain, most significant bit first.
+ * @param value byte to send
+ */
+static inline void Max7219ShiftByte(uint8_t value)
+{
+		for(uint8_t mask = 0x80U; mask != 0U; mask >>= 1)
+		{
+				if((value & mask) != 0U)
+				{
+						PORTB |= (1U << MAX7219_DIN_BIT);
+				}
+				else
+				{
+						PORTB &= (uint8_t)~(1U << MAX7219_DIN_BIT);
+				}
+				PORTB |= (1U << MAX7219_CLK_BIT);
+				PORTB &= (uint8_t)~(1U << MAX7219_CLK_BIT);
+		}
+}
+
+
+/**
+ * Max7219WriteAll
+ *
+ * Writes the same value to a register on every device on the chain.
+ * @param reg   MAX7219 register
+ * @param value value to write to it
+ */
+void Max7219WriteAll(uint8_t reg, uint8_t value)
+{
+		PORTB &= (uint8_t)~(1U << MAX7219_CS_BIT);
+		for(uint8_t device = 0U; device < MAX7219_NUM_DEVICES; device++)
+		{
+				Max7219ShiftByte(reg);
+				Max7219ShiftByte(value);
+		}
+		PORTB |= (1U << MAX7219_CS_BIT);
+}
+
+
+/**
+ * Max7219WriteRow
+ *
+ * Writes one digit register on every device on the chain in a single frame.
+ * The last device on the chain is sent first, so that each device ends up
+ * with its own value when CS goes high, the same order that LedControl uses.
+ * @param row    digit register 0 to 7
+ * @param values segments for the row, one for each device, device 0 first
+ */
+void Max7219WriteRow(uint8_t row, const uint8_t values[MAX7219_NUM_DEVICES])
+{
+		uint8_t reg = (uint8_t)(MAX7219_REG_DIGIT0 + row);
+
+		PORTB &= (uint8_t)~(1U << MAX7219_CS_BIT);
+		for(uint8_t device = MAX7219_NUM_DEVICES; device > 0U; device--)
+		{
+				Max7219ShiftByte(reg);
+				Max7219ShiftByte(values[device - 1U]);
+		}
+		PORTB |= (1U << MAX7219_CS_BIT);
+}
+
+
+/**
+ * Max7219Setup
+ *
+ * Sets up the pins, and puts every device into no decode mode, scanning all
+ * 8 digits, with all the digits blank.
+ * @param intensity brightness from 0 to 15
+ */
+void Max7219Setup(uint8_t intensity)
+{
+		PORTB |= (1U << MAX7219_CS_BIT);
+		PORTB &= (uint8_t)~((1U << MAX7219_CLK_BIT) | (1U << MAX7219_DIN_BIT));
+		DDRB |= (1U << MAX7219_DIN_BIT) | (1U << MAX7219_CLK_BIT) | (1U << MAX7219_CS_BIT);
+
+		Max7219WriteAll(MAX7219_REG_DISPLAY_TEST, 0U);
+		Max7219WriteAll(MAX7219_REG_SCAN_LIMIT, MAX7219_NUM_DIGITS - 1U);
+		Max7219WriteAll(MAX7219_REG_DECODE_MODE, 0U);
+		Max7219WriteAll(MAX7219_REG_INTENSITY, intensity);
+		for(uint8_t row = 0U; row < MAX7219_NUM_DIGITS; row++)
+		{
+				Max7219WriteAll((uint8_t)(MAX7219_REG_DIGIT0 + row), 0U);
+		}
+		Max7219WriteAll(MAX7219_REG_SHUTDOWN, 1U);
+}
@@ -0,0 +1,40 @@
+/*
+ * Max7219.h
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef MAX7219_H
+#define MAX7219_H
+
+/* Number of MAX7219s on the chain */
+#define MAX7219_NUM_DEVICES 4U
+
+/* MAX7219 registers, digit 0 to 7 are registers 1 to 8 */
+#define MAX7219_REG_NOOP        0x00U
+#define MAX7219_REG_DIGIT0      0x01U
+#define MAX7219_REG_DECODE_MODE 0x09U
+#define MAX7219_REG_INTENSITY   0x0AU
+#define MAX7219_REG_SCAN_LIMIT  0x0BU
+#define MAX7219_REG_SHUTDOWN    0x0CU
+#define MAX7219_REG_DISPLAY_TEST 0x0FU
+
+extern void Max7219Setup(uint8_t intensity);
+extern void Max7219WriteAll(uint8_t reg, uint8_t value);
+extern void Max7219WriteRow(uint8_t row, const uint8_t values[MAX7219_NUM_DEVICES]);
+#endif /* MAX7219_H */
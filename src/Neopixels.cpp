@@ -7,7 +7,9 @@
  *
  * Driver for the neopixels used on the OpenDSKY hardware, it allows individual
  * neopixels to be controlled by their openDSKY name. Both RGB and RGBW
- * neopixels are supported
+ * neopixels are supported, RGBW is used unless NEOPIXEL_RGB is defined (the
+ * nanoatmega328_rgb environment in platformio.ini defines it). The colours
+ * are packed for the strip at compile time, and kept in flash.
  *
  * This modules uses the following libraries:
  *
@@ -35,39 +37,195 @@
 /* Arduino libraries */
 #include <Adafruit_NeoPixel.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 
 /* Open DSKY headers */
 #include "Neopixels.h"
+#include "GPS.h"
+#include "Scheduler.h"
 #include "main.h"
 
-#define RGBW /* Use this if you have got RGBW (4 Colour) Neo Pixels, otherwise
-	            it will default to 3 Colour ones */
+/* Use this if you have got RGB (3 Colour) Neo Pixels, otherwise it will default
+   to 4 Colour RGBW ones */
+//#define NEOPIXEL_RGB
 
-#ifdef RGBW
-Adafruit_NeoPixel strip = Adafruit_NeoPixel(18, 6, NEO_GRBW + NEO_KHZ800);
+/* Each colour has a value for RGB strips and a value for RGBW strips, which
+   can use the white LED. The table must be in PixelColoursEnum order, without
+   RAINBOW_COLOUR, which is worked out as it goes. */
+#define NEOPIXEL_COLOUR_TABLE(ENTRY) \
+		/*     colour             RGB strip        RGBW strip */ \
+		ENTRY( WARM_WHITE_COLOUR, 255, 255, 220,   240, 240,   0, 255) \
+		ENTRY( COOL_WHITE_COLOUR, 255, 255, 255,   255, 255, 255, 255) \
+		ENTRY( PURE_WHITE_COLOUR, 255, 255, 255,     0,   0,   0, 255) \
+		ENTRY( RED_COLOUR,        255,   0,   0,   255,   0,   0,   0) \
+		ENTRY( GREEN_COLOUR,        0, 255,   0,     0, 255,   0,   0) \
+		ENTRY( BLUE_COLOUR,         0,   0, 255,     0,   0, 255,   0) \
+		ENTRY( AMBER_COLOUR,      255,  90,   0,   255,  90,   0,   0) \
+		ENTRY( YELLOW_COLOUR,     255, 255,   0,   255, 255,   0,   0) \
+		ENTRY( CYAN_COLOUR,         0, 255, 255,     0, 255, 255,   0) \
+		ENTRY( MAGENTA_COLOUR,    255,   0, 255,   255,   0, 255,   0)
+
+/* Colour policies for each kind of strip, they pack colours the same way as
+   strip.Color, but at compile time */
+struct NeoPixelRGBPolicy
+{
+		static constexpr neoPixelType StripType = NEO_GRB + NEO_KHZ800;
+
+		static constexpr uint32_t Pack(uint8_t red, uint8_t green, uint8_t blue, uint8_t white)
+		{
+				return ((uint32_t)red << 16) | ((uint32_t)green << 8) | (uint32_t)blue;
+		}
+
+		static constexpr uint32_t Colour(uint8_t red, uint8_t green, uint8_t blue,
+		                                 uint8_t wRed, uint8_t wGreen, uint8_t wBlue, uint8_t wWhite)
+		{
+				return Pack(red, green, blue, 0U);
+		}
+};
+
+struct NeoPixelRGBWPolicy
+{
+		static constexpr neoPixelType StripType = NEO_GRBW + NEO_KHZ800;
+
+		static constexpr uint32_t Pack(uint8_t red, uint8_t green, uint8_t blue, uint8_t white)
+		{
+				return ((uint32_t)white << 24) | ((uint32_t)red << 16) | ((uint32_t)green << 8) | (uint32_t)blue;
+		}
+
+		static constexpr uint32_t Colour(uint8_t red, uint8_t green, uint8_t blue,
+		                                 uint8_t wRed, uint8_t wGreen, uint8_t wBlue, uint8_t wWhite)
+		{
+				return Pack(wRed, wGreen, wBlue, wWhite);
+		}
+};
+
+#ifdef NEOPIXEL_RGB
+typedef NeoPixelRGBPolicy NeoPixelPolicy;
 #else
-Adafruit_NeoPixel strip = Adafruit_NeoPixel(18, 6, NEO_GRB + NEO_KHZ800);
+typedef NeoPixelRGBWPolicy NeoPixelPolicy;
 #endif
 
+#define NEOPIXEL_COLOUR_ENTRY(colour, red, green, blue, wRed, wGreen, wBlue, wWhite) \
+		NeoPixelPolicy::Colour(red, green, blue, wRed, wGreen, wBlue, wWhite),
+
+#define NEOPIXEL_COLOUR_ORDER_ENTRY(colour, red, green, blue, wRed, wGreen, wBlue, wWhite) \
+		colour,
+
+static const uint32_t neoPixelColours[] PROGMEM =
+{
+		NEOPIXEL_COLOUR_TABLE(NEOPIXEL_COLOUR_ENTRY)
+};
+
+static constexpr PixelColoursEnum neoPixelColourOrder[] =
+{
+		NEOPIXEL_COLOUR_TABLE(NEOPIXEL_COLOUR_ORDER_ENTRY)
+};
+
+/* true if every entry from idx onwards is in its PixelColoursEnum place */
+static constexpr bool NeoPixelColoursInOrder(uint8_t idx)
+{
+		return (idx >= (sizeof(neoPixelColourOrder) / sizeof(neoPixelColourOrder[0]))) ? true :
+		       ((neoPixelColourOrder[idx] == (PixelColoursEnum)idx) && NeoPixelColoursInOrder(idx + 1U));
+}
+
+static_assert((sizeof(neoPixelColours) / sizeof(neoPixelColours[0])) == RAINBOW_COLOUR,
+              "NEOPIXEL_COLOUR_TABLE needs an entry for every colour but RAINBOW_COLOUR");
+static_assert(NeoPixelColoursInOrder(0U), "NEOPIXEL_COLOUR_TABLE is not in PixelColoursEnum order");
+
+Adafruit_NeoPixel strip = Adafruit_NeoPixel(18, 6, NeoPixelPolicy::StripType);
+
 #define TWO_HUNDRED_MILLISECONDS    20
 #define FOUR_HUNDRED_MILLISECONDS   40
 #define EIGHT_HUNDRED_MILLISECONDS  80
 
-Thread* neoPixelThread = new Thread();
+/* The lamp clock goes round every NEOPIXEL_CLOCK_TICKS, which all the flash,
+   breath and rainbow periods divide into, so they never jump as it wraps */
+#define NEOPIXEL_CLOCK_TICKS 1280U
+
+/* strip.Color(0,0,0) and strip.Color(0,0,0,0) are both 0 */
+#define NEOPIXEL_OFF 0UL
+
+/* Levels a pixel can be lit at, in between is dimmed */
+#define NEOPIXEL_LEVEL_OFF  0U
+#define NEOPIXEL_LEVEL_FULL 255U
+
+/* The most ticks the strip will wait for the GPS before it is sent anyway,
+   kept short so that the flashes still keep time */
+#define NEOPIXEL_MAX_DEFER_TICKS 2U
+
+/* Fades take NEOPIXEL_FADE_TICKS ticks, the level goes up by
+   1 << NEOPIXEL_FADE_SHIFT each tick */
+#define NEOPIXEL_FADE_TICKS 64U
+#define NEOPIXEL_FADE_SHIFT 2U
+
+/* A breath is NEOPIXEL_BREATH_STEPS steps of 1 << NEOPIXEL_BREATH_SHIFT ticks */
+#define NEOPIXEL_BREATH_STEPS 64U
+#define NEOPIXEL_BREATH_SHIFT 1U
+
+/* Brightness the eye sees for each level, a gamma of 2.6 */
+static const uint8_t neoPixelGamma[256] PROGMEM =
+{
+		  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+		  0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   1,   1,
+		  1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,   2,   3,   3,   3,   3,
+		  3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   5,   6,   6,   6,   6,   7,
+		  7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  10,  11,  11,  11,  12,  12,
+		 13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,  20,
+		 20,  21,  21,  22,  22,  23,  24,  24,  25,  25,  26,  27,  27,  28,  29,  29,
+		 30,  31,  31,  32,  33,  34,  34,  35,  36,  37,  38,  38,  39,  40,  41,  42,
+		 42,  43,  44,  45,  46,  47,  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,
+		 58,  59,  60,  61,  62,  63,  64,  65,  66,  68,  69,  70,  71,  72,  73,  75,
+		 76,  77,  78,  80,  81,  82,  84,  85,  86,  88,  89,  90,  92,  93,  94,  96,
+		 97,  99, 100, 102, 103, 105, 106, 108, 109, 111, 112, 114, 115, 117, 119, 120,
+		122, 124, 125, 127, 129, 130, 132, 134, 136, 137, 139, 141, 143, 145, 146, 148,
+		150, 152, 154, 156, 158, 160, 162, 164, 166, 168, 170, 172, 174, 176, 178, 180,
+		182, 184, 186, 188, 191, 193, 195, 197, 199, 202, 204, 206, 209, 211, 213, 215,
+		218, 220, 223, 225, 227, 230, 232, 235, 237, 240, 242, 245, 247, 250, 252, 255
+};
+
+/* Level through one breath, a raised cosine, the gamma makes it look right */
+static const uint8_t neoPixelBreath[NEOPIXEL_BREATH_STEPS] PROGMEM =
+{
+		  0,   1,   2,   5,  10,  15,  21,  29,  37,  47,  57,  67,  79,  90, 103, 115,
+		127, 140, 152, 165, 176, 188, 198, 208, 218, 226, 234, 240, 245, 250, 253, 254,
+		255, 254, 253, 250, 245, 240, 234, 226, 218, 208, 198, 188, 176, 165, 152, 140,
+		128, 115, 103,  90,  79,  67,  57,  47,  37,  29,  21,  15,  10,   5,   2,   1
+};
+
+static_assert((NEOPIXEL_CLOCK_TICKS % EIGHT_HUNDRED_MILLISECONDS) == 0U, "flashes would jump as the lamp clock wraps");
+static_assert((NEOPIXEL_CLOCK_TICKS % (NEOPIXEL_BREATH_STEPS << NEOPIXEL_BREATH_SHIFT)) == 0U,
+              "breaths would jump as the lamp clock wraps");
+static_assert((NEOPIXEL_CLOCK_TICKS % 128U) == 0U, "rainbows would jump as the lamp clock wraps");
+
+SchedulerThread* neoPixelThread = new SchedulerThread();
 
 typedef struct NEOPIXEL_CONTROL_STRUCT
 {
-		uint8_t Colour;
-		uint8_t OnState;
-		uint8_t ActionCount;
+		uint8_t Colour : 4;     /* PixelColoursEnum */
+		uint8_t OnState : 4;    /* PixelOnStateEnum */
+		uint8_t FadeCount : 7;  /* ticks into a fade, only counted while fading */
+		uint8_t Stale : 1;      /* the colour or effect has changed since the pixel was written */
+		uint8_t Level;          /* level the pixel was last written at */
 
 }NeoPixelControlStruct;
 
+static_assert(NUM_COLOURS <= 16U, "PixelColoursEnum no longer fits in NeoPixelControlStruct.Colour");
+static_assert(NUM_PIXEL_ON_STATES <= 16U, "PixelOnStateEnum no longer fits in NeoPixelControlStruct.OnState");
+static_assert(NEOPIXEL_FADE_TICKS < 128U, "a fade no longer fits in NeoPixelControlStruct.FadeCount");
+
 NeoPixelControlStruct NeoPixelControlTable[NUM_PIXELS] = {0U,};
 
-static void NeoPixelSetPixelColour(uint8_t idx, PixelColoursEnum Colour);
+/* true when a pixel has been changed since the strip was last shown */
+static bool neoPixelDirty = false;
+/* Ticks of the lamp clock, every effect is timed from this, so lamps
+   flashing at the same rate flash together */
+static uint16_t neoPixelClock = 0U;
+static uint8_t neoPixelDeferTicks = 0U;
+static uint16_t neoPixelDeferred = 0U;   /* ticks the strip waited for the GPS */
+static uint16_t neoPixelOverlapped = 0U; /* times the strip was sent while GPS bytes were waiting */
+
+static void NeoPixelWritePixel(uint8_t idx, uint8_t level);
+static uint32_t NeoPixelColourValue(PixelColoursEnum colour);
 static uint32_t Wheel(byte wheelPos);
 
 
@@ -93,93 +251,130 @@ void NeoPixelSetup(void)
 /**
  * NeoPixelThreadCallback
  *
- * Main thread callback for the neopixel library. This get called frequently
- * so as to make sure any flashing and fading effects are smooth. Every 10ms
- * a counter is incremented (ActionCount) this can then be used by the effects
- * to drive their status.
+ * Main thread callback for the neopixel library, called every tick to keep
+ * the effects smooth. Each tick the lamp clock moves on, and the flashes,
+ * breaths, rainbows and random flickers are all timed from it, so lamps with
+ * the same effect stay in step like those on the real DSKY. Fades are timed
+ * from when they were set. Every effect gives a level for its pixel, which is
+ * gamma corrected and scales the pixel's colour with integer maths. A pixel is
+ * only written when its level or colour changes, and the strip is sent once,
+ * at the end, if any pixel was written. Interrupts are off while the strip is
+ * sent, which can lose bytes from the GPS, so it waits while GPS bytes are
+ * coming in, for up to NEOPIXEL_MAX_DEFER_TICKS.
  */
 void NeoPixelThreadCallback(void)
 {
+		uint8_t level;
+		uint8_t slowFlashLevel;
+		uint8_t fastFlashLevel;
+		uint8_t breathLevel;
+
+		neoPixelClock++;
+		if(neoPixelClock >= NEOPIXEL_CLOCK_TICKS)
+		{
+				neoPixelClock = 0U;
+		}
+		slowFlashLevel = ((neoPixelClock % EIGHT_HUNDRED_MILLISECONDS) < FOUR_HUNDRED_MILLISECONDS) ?
+		                 NEOPIXEL_LEVEL_FULL : NEOPIXEL_LEVEL_OFF;
+		fastFlashLevel = ((neoPixelClock % FOUR_HUNDRED_MILLISECONDS) < TWO_HUNDRED_MILLISECONDS) ?
+		                 NEOPIXEL_LEVEL_FULL : NEOPIXEL_LEVEL_OFF;
+		breathLevel = pgm_read_byte(&neoPixelBreath[(neoPixelClock >> NEOPIXEL_BREATH_SHIFT) &
+		                                            (NEOPIXEL_BREATH_STEPS - 1U)]);
 
 		for(uint8_t idx = 0U; idx < (uint8_t)NUM_PIXELS; idx++)
 		{
-				NeoPixelControlTable[idx].ActionCount++;
-				switch (NeoPixelControlTable[idx].OnState)
+				NeoPixelControlStruct* control = &NeoPixelControlTable[idx];
+
+				level = control->Level;
+				switch (control->OnState)
 				{
 
 				case PIXEL_ON:
-						NeoPixelSetPixelColour(idx, (PixelColoursEnum)NeoPixelControlTable[idx].Colour);
+						level = NEOPIXEL_LEVEL_FULL;
 						break;
 				case PIXEL_SLOW_FLASH:
-						if(NeoPixelControlTable[idx].ActionCount < FOUR_HUNDRED_MILLISECONDS)
-						{
-								NeoPixelSetPixelColour(idx, (PixelColoursEnum)NeoPixelControlTable[idx].Colour);
-						}
-						else if(NeoPixelControlTable[idx].ActionCount < EIGHT_HUNDRED_MILLISECONDS)
-						{
-#ifdef RGBW
-								strip.setPixelColor(idx, strip.Color(0,0,0,0) );
-#else
-								strip.setPixelColor(idx, strip.Color(0,0,0) );
-#endif
-						}
-						else
-						{
-								NeoPixelControlTable[idx].ActionCount = 0;
-						}
+						level = slowFlashLevel;
 						break;
 				case PIXEL_FAST_FLASH:
-						if(NeoPixelControlTable[idx].ActionCount < TWO_HUNDRED_MILLISECONDS)
-						{
-								NeoPixelSetPixelColour(idx, (PixelColoursEnum)NeoPixelControlTable[idx].Colour);
-						}
-						else if(NeoPixelControlTable[idx].ActionCount < FOUR_HUNDRED_MILLISECONDS)
+						level = fastFlashLevel;
+						break;
+				case PIXEL_FADE_UP:
+				case PIXEL_FADE_DOWN:
+						/* hold at the end of the fade */
+						if(control->FadeCount < NEOPIXEL_FADE_TICKS)
 						{
-#ifdef RGBW
-								strip.setPixelColor(idx, strip.Color(0,0,0,0) );
-#else
-								strip.setPixelColor(idx, strip.Color(0,0,0) );
-#endif
+								control->FadeCount++;
 						}
-						else
+						level = (uint8_t)min((uint16_t)control->FadeCount << NEOPIXEL_FADE_SHIFT, NEOPIXEL_LEVEL_FULL);
+						if(control->OnState == PIXEL_FADE_DOWN)
 						{
-								NeoPixelControlTable[idx].ActionCount = 0;
+								level = NEOPIXEL_LEVEL_FULL - level;
 						}
 						break;
-						break;
-				case PIXEL_FADE_UP:
-				case PIXEL_FADE_DOWN:
 				case PIXEL_BREATH:
-						/* not yet supported, need to do hv<->rgb for that */
+						level = breathLevel;
 						break;
 				case PIXEL_RANDOM:
-						if(random(255) > NeoPixelControlTable[idx].ActionCount)
+						if(random(255) > (uint8_t)neoPixelClock)
 						{
-								if(random(2) == 0)
-								{
-										NeoPixelSetPixelColour(idx, (PixelColoursEnum)NeoPixelControlTable[idx].Colour);
-								}
-								else
-								{
-#ifdef RGBW
-										strip.setPixelColor(idx, strip.Color(0,0,0,0) );
-#else
-										strip.setPixelColor(idx, strip.Color(0,0,0) );
-#endif
-								}
+								level = (random(2) == 0) ? NEOPIXEL_LEVEL_FULL : NEOPIXEL_LEVEL_OFF;
 						}
-
 						break;
 				case PIXEL_OFF:
 				default:
-#ifdef RGBW
-						strip.setPixelColor(idx, strip.Color(0,0,0,0) );
-#else
-						strip.setPixelColor(idx, strip.Color(0,0,0) );
-#endif
+						level = NEOPIXEL_LEVEL_OFF;
 						break;
 				}
+
+				/* a lit rainbow changes colour every tick */
+				if(control->Stale || (level != control->Level) ||
+				   ((control->Colour == RAINBOW_COLOUR) && (level != NEOPIXEL_LEVEL_OFF)))
+				{
+						NeoPixelWritePixel(idx, level);
+				}
 		}
+
+		if(neoPixelDirty)
+		{
+				if(GPSSerialBusy() && (neoPixelDeferTicks < NEOPIXEL_MAX_DEFER_TICKS))
+				{
+						neoPixelDeferTicks++;
+						neoPixelDeferred++;
+				}
+				else
+				{
+						if(GPSSerialBusy())
+						{
+								neoPixelOverlapped++;
+						}
+						strip.show();
+						neoPixelDirty = false;
+						neoPixelDeferTicks = 0U;
+				}
+		}
+}
+
+
+/**
+ * NeoPixelDeferredCommits
+ *
+ * @return  the number of ticks the strip has waited for GPS bytes to be read
+ */
+uint16_t NeoPixelDeferredCommits(void)
+{
+		return neoPixelDeferred;
+}
+
+
+/**
+ * NeoPixelOverlappedCommits
+ *
+ * @return  the number of times the strip had waited too long, and was sent
+ *          while GPS bytes were still waiting to be read
+ */
+uint16_t NeoPixelOverlappedCommits(void)
+{
+		return neoPixelOverlapped;
 }
 
 
@@ -199,106 +394,71 @@ void NeoPixelSetState(NeopixelWordEnum word, PixelColoursEnum colour, PixelOnSta
 
 				if(NeoPixelControlTable[word].OnState != (uint8_t)state)
 				{
-						NeoPixelControlTable[word].ActionCount = 0;
+						NeoPixelControlTable[word].FadeCount = 0U;
+						NeoPixelControlTable[word].Stale = 1U;
+				}
+				if(NeoPixelControlTable[word].Colour != (uint8_t)colour)
+				{
+						NeoPixelControlTable[word].Stale = 1U;
 				}
 				NeoPixelControlTable[word].Colour = (uint8_t)colour;
 				NeoPixelControlTable[word].OnState = (uint8_t)state;
 		}
 }
 
+
 /**
- * NeoPixelSetPixelColour
+ * NeoPixelWritePixel
  *
- *  Sets the specified pixel to the specified colour
- * @param idx    index of the pixel to set
- * @param Colour PixelColoursEnum with the colour to set to.
+ * Gives a pixel its colour, dimmed to a level, in the strip's buffer. The
+ * level is gamma corrected, and each channel is scaled by it with integer
+ * maths, so NEOPIXEL_LEVEL_FULL is the colour itself and NEOPIXEL_LEVEL_OFF
+ * is off. The strip isn't sent until the end of NeoPixelThreadCallback.
+ * @param idx   index of the pixel to set
+ * @param level how bright the pixel should look
  */
-static void NeoPixelSetPixelColour(uint8_t idx, PixelColoursEnum colour)
+static void NeoPixelWritePixel(uint8_t idx, uint8_t level)
 {
+		uint32_t pixel = NeoPixelColourValue((PixelColoursEnum)NeoPixelControlTable[idx].Colour);
+		uint16_t scale = (uint16_t)pgm_read_byte(&neoPixelGamma[level]) + 1U;
+		uint32_t scaled = 0UL;
 
-		switch (colour)
+		for(uint8_t shift = 0U; shift < 32U; shift += 8U)
 		{
-		case WARM_WHITE_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(240,240,0, 255) );
-#else
-				strip.setPixelColor(idx, strip.Color(255,255,220) );
-#endif
-				break;
-		case COOL_WHITE_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(255,255,255, 255) );
-#else
-				strip.setPixelColor(idx, strip.Color(255,255,255) );
-#endif
-				break;
-		case PURE_WHITE_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(0,0,0, 255) );
-#else
-				strip.setPixelColor(idx, strip.Color(255,255,255) );
-#endif
-				break;
-		case RED_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(255,0,0, 0) );
-#else
-				strip.setPixelColor(idx, strip.Color(255,0,0) );
-#endif
-				break;
-		case GREEN_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(0,255,0, 0) );
-#else
-				strip.setPixelColor(idx, strip.Color(0,255,0) );
-#endif
-				break;
-		case AMBER_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(255,90,0, 0) );
-#else
-				strip.setPixelColor(idx, strip.Color(255,90,0) );
-#endif
-				break;
-		case BLUE_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(0,0,255, 0) );
-#else
-				strip.setPixelColor(idx, strip.Color(0,0,255) );
-#endif
-				break;
-		case YELLOW_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(255,255,0, 0) );
-#else
-				strip.setPixelColor(idx, strip.Color(255,255,0) );
-#endif
-				break;
-		case CYAN_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(0,255,255, 0) );
-#else
-				strip.setPixelColor(idx, strip.Color(0,255,255) );
-#endif
-				break;
-		case MAGENTA_COLOUR:
-#ifdef RGBW
-				strip.setPixelColor(idx, strip.Color(255,0,255, 0) );
-#else
-				strip.setPixelColor(idx, strip.Color(255,0,255) );
-#endif
-				break;
-		case RAINBOW_COLOUR:
-				strip.setPixelColor(idx, Wheel((NeoPixelControlTable[idx].ActionCount) & 255));
-				NeoPixelControlTable[idx].ActionCount++;
+				scaled |= (uint32_t)((((uint16_t)(pixel >> shift) & 0xFFU) * scale) >> 8) << shift;
+		}
+		strip.setPixelColor(idx, scaled);
+		NeoPixelControlTable[idx].Level = level;
+		NeoPixelControlTable[idx].Stale = 0U;
+		neoPixelDirty = true;
+}
 
-				break;
 
-		default:
-				/* do nothing */
-				break;
+/**
+ * NeoPixelColourValue
+ *
+ * Gets the packed value of a colour, RAINBOW_COLOUR goes round the colour
+ * wheel with the lamp clock.
+ * @param  colour PixelColoursEnum with the colour
+ * @return        the colour packed for the strip
+ */
+static uint32_t NeoPixelColourValue(PixelColoursEnum colour)
+{
+		uint32_t pixel;
+
+		if(colour == RAINBOW_COLOUR)
+		{
+				pixel = Wheel((byte)(neoPixelClock << 1));
+		}
+		else if(colour < RAINBOW_COLOUR)
+		{
+				pixel = pgm_read_dword(&neoPixelColours[colour]);
 		}
-		strip.show();
+		else
+		{
+				pixel = NEOPIXEL_OFF;
+		}
+		return pixel;
 }
 
 
@@ -315,26 +475,13 @@ static uint32_t Wheel(byte wheelPos) {
 		wheelPos = 255 - wheelPos;
 		if(wheelPos < 85)
 		{
-#ifdef RGBW
-				return strip.Color(255 - wheelPos * 3, 0, wheelPos * 3,0);
-#else
-				return strip.Color(255 - wheelPos * 3, 0, wheelPos * 3);
-#endif
-
+				return NeoPixelPolicy::Pack(255 - wheelPos * 3, 0, wheelPos * 3, 0);
 		}
 		if(wheelPos < 170)
 		{
 				wheelPos -= 85;
-#ifdef RGBW
-				return strip.Color(0, wheelPos * 3, 255 - wheelPos * 3,0);
-#else
-				return strip.Color(0, wheelPos * 3, 255 - wheelPos * 3);
-#endif
+				return NeoPixelPolicy::Pack(0, wheelPos * 3, 255 - wheelPos * 3, 0);
 		}
 		wheelPos -= 170;
-#ifdef RGBW
-		return strip.Color(wheelPos * 3, 255 - wheelPos * 3, 0,0);
-#else
-		return strip.Color(wheelPos * 3, 255 - wheelPos * 3, 0);
-#endif
+		return NeoPixelPolicy::Pack(wheelPos * 3, 255 - wheelPos * 3, 0, 0);
 }
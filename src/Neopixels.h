@@ -80,4 +80,6 @@ typedef enum PIXEL_ON_STATE_ENUM
 extern void NeoPixelThreadCallback(void);
 extern void NeoPixelSetup(void);
 extern void NeoPixelSetState(NeopixelWordEnum Word, PixelColoursEnum Colour, PixelOnStateEnum State);
+extern uint16_t NeoPixelDeferredCommits(void);
+extern uint16_t NeoPixelOverlappedCommits(void);
 #endif
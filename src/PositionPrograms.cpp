@@ -22,7 +22,6 @@
 
  #include <Wire.h>
  #include <Thread.h>
- #include <ThreadController.h>
  #include <TimerOne.h>
  #include <math.h>
 
@@ -33,13 +32,15 @@
  #include <helper_3dmath.h>
  #include "IMU.h"
  #include "PositionPrograms.h"
+ #include "ThreadPool.h"
+ #include "Scheduler.h"
  #include "main.h"
 
 
 Thread* V16N43Thread = NULL;
 Thread* V16N29Thread = NULL;
 Thread* V16N30Thread = NULL;
-static SevenSegmentDisplayStruct PositionProgramDisplayData;
+static SevenSegmentFrameStruct PositionProgramFrame;
 static uint8_t ActiveProgram = 0; /* Used to track which program is updating the
                                      display data */
 
@@ -47,61 +48,32 @@ static uint8_t ActiveProgram = 0; /* Used to track which program is updating the
  * V16N43ThreadCallback
  *
  * Shows the GPS latitude longitude and altitude information. As there are no
- * decimal places, use a blank digit as a decimal.
+ * decimal places, the display driver uses a blank digit as a decimal.
  */
 void V16N43ThreadCallback(void)
 {
+		SevenSegmentDisplayStruct* displayData;
 
 		if(ActiveProgram != 1)
 		{
 				return;
 		}
-		double lat = GPSGetLatitude();
-		double lon = GPSGetLongitude();
-    int32_t mag;
+		/* Degrees to 3 decimal places, and feet */
+		int32_t lat = static_cast<int32_t>(GPSGetLatitude() * 1000.0);
+		int32_t lon = static_cast<int32_t>(GPSGetLongitude() * 1000.0);
+		int32_t alt = static_cast<int32_t>(GPSGetAltitude());
 
-		/* no decimal place, so use a blank instead of decimal. This means we need
-		   to work out how many digits can be shown */
-		if(abs(lat) >= 100.0)
-		{
-				PositionProgramDisplayData.R1DigitShowMask = 0x3D;
-        mag = 10;
-		}
-		else if(abs(lat) >= 10.0)
-		{
-				PositionProgramDisplayData.R1DigitShowMask = 0x3B;
-        mag = 100;
-		}
-		else
-		{
-				PositionProgramDisplayData.R1DigitShowMask = 0x37;
-        mag = 1000;
-		}
-  	PositionProgramDisplayData.R1 = (static_cast<int32_t>(lat * (double)mag)%mag) + (static_cast<int32_t>(lat) * mag);
-
-		if(abs(lon) >= 100.0)
-		{
-				PositionProgramDisplayData.R2DigitShowMask = 0x3D;
-        mag = 10;
-		}
-		else if(abs(lon) >= 10.0)
-		{
-				PositionProgramDisplayData.R2DigitShowMask = 0x3B;
-        mag = 100;
-		}
-		else
-		{
-				PositionProgramDisplayData.R2DigitShowMask = 0x37;
-        mag = 1000;
-		}
-		PositionProgramDisplayData.R2 = (static_cast<int32_t>(lon * (double)mag)%mag) + (static_cast<int32_t>(lon) * mag);
+		displayData = SevenSegmentBeginFrame(&PositionProgramFrame);
 
-  	PositionProgramDisplayData.R3 = static_cast<int32_t>(GPSGetAltitude())%10000;
-    PositionProgramDisplayData.R3DigitShowMask = 0x3F;
+		/* The display driver fits in as many decimal places as it can */
+		SevenSegmentSetRegister(displayData, SEVEN_SEGMENT_R1, lat, 3U, SEVEN_SEGMENT_SIGN_AUTO);
+		SevenSegmentSetRegister(displayData, SEVEN_SEGMENT_R2, lon, 3U, SEVEN_SEGMENT_SIGN_AUTO);
+		SevenSegmentSetRegister(displayData, SEVEN_SEGMENT_R3, alt, 0U, SEVEN_SEGMENT_SIGN_AUTO);
 
-		PositionProgramDisplayData.Verb = 16;
-		PositionProgramDisplayData.Noun = 43;
-		PositionProgramDisplayData.Prog = 0;
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(43);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		SevenSegmentPublishFrame(&PositionProgramFrame);
 
 
 		NeoPixelSetState(VERB_PIXEL,GREEN_COLOUR,PIXEL_ON);
@@ -117,11 +89,11 @@ void V16N43ThreadCallback(void)
  * Returns a pointer to a structure of type SevenSegmentDisplayStruct that
  * contains the 7 Segment display data for whichever program in this module
  * is running in the FOREGROUND.
- * @return  SevenSegmentDisplayStruct pointer.
+ * @return  SevenSegmentDisplayStruct pointer to the last published frame.
  */
-SevenSegmentDisplayStruct* PositionGetDisplayData(void)
+const SevenSegmentDisplayStruct* PositionGetDisplayData(void)
 {
-		return &PositionProgramDisplayData;
+		return SevenSegmentFrontBuffer(&PositionProgramFrame);
 }
 
 /**
@@ -143,10 +115,11 @@ ProgramRunStateEnum V16N43ShowGPSPosition(ProgramCallStateEnum call)
 				/* Check if the thread already exists before we try to create it. */
 				if(V16N43Thread == NULL)
 				{
-						V16N43Thread = new Thread();
-						V16N43Thread->onRun(V16N43ThreadCallback);
-						V16N43Thread->setInterval(500);
-						controll.add(V16N43Thread);
+						V16N43Thread = ThreadPoolAcquire(V16N43ThreadCallback, 500);
+						if(V16N43Thread == NULL)
+						{
+								return NOT_RUNNING;
+						}
 						ActiveProgram = 1;
 						return FOREGROUND;
 				}
@@ -179,8 +152,7 @@ ProgramRunStateEnum V16N43ShowGPSPosition(ProgramCallStateEnum call)
 				{
 						ActiveProgram = 0;
 						NeoPixelSetState(TRACKER_PIXEL,WARM_WHITE_COLOUR,PIXEL_OFF);
-						controll.remove(V16N43Thread);
-						delete[] V16N43Thread;
+						ThreadPoolRelease(V16N43Thread);
 						V16N43Thread = NULL;
 				}
 				return NOT_RUNNING;
@@ -197,23 +169,23 @@ ProgramRunStateEnum V16N43ShowGPSPosition(ProgramCallStateEnum call)
  */
 void V16N29ThreadCallback(void)
 {
+		SevenSegmentDisplayStruct* displayData;
 		VectorInt16 rawData = GetGyroRaw();
 		if(ActiveProgram != 2)
 		{
 				return;
 		}
 
-		PositionProgramDisplayData.R1 = rawData.x;
-		PositionProgramDisplayData.R2 = rawData.y;
-		PositionProgramDisplayData.R3 = rawData.z;
+		displayData = SevenSegmentBeginFrame(&PositionProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, rawData.x, 0x3F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, rawData.y, 0x3F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, rawData.z, 0x3F);
 
 
-		PositionProgramDisplayData.Verb = 16;
-		PositionProgramDisplayData.Noun = 29;
-		PositionProgramDisplayData.Prog = 0;
-		PositionProgramDisplayData.R1DigitShowMask = 0x3F;
-		PositionProgramDisplayData.R2DigitShowMask = 0x3F;
-		PositionProgramDisplayData.R3DigitShowMask = 0x3F;
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(29);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		SevenSegmentPublishFrame(&PositionProgramFrame);
 
 }
 
@@ -236,10 +208,11 @@ ProgramRunStateEnum V16N29ShowIMUGyro(ProgramCallStateEnum call)
 				/* Check if the thread already exists before we try to create it. */
 				if(V16N29Thread == NULL)
 				{
-						V16N29Thread = new Thread();
-						V16N29Thread->onRun(V16N29ThreadCallback);
-						V16N29Thread->setInterval(100);
-						controll.add(V16N29Thread);
+						V16N29Thread = ThreadPoolAcquire(V16N29ThreadCallback, 100);
+						if(V16N29Thread == NULL)
+						{
+								return NOT_RUNNING;
+						}
 						ActiveProgram = 2;
 						return FOREGROUND;
 				}
@@ -271,8 +244,7 @@ ProgramRunStateEnum V16N29ShowIMUGyro(ProgramCallStateEnum call)
 				if(V16N29Thread != NULL)
 				{
 						NeoPixelSetState(TRACKER_PIXEL,WARM_WHITE_COLOUR,PIXEL_OFF);
-						controll.remove(V16N29Thread);
-						delete[] V16N29Thread;
+						ThreadPoolRelease(V16N29Thread);
 						V16N29Thread = NULL;
 						ActiveProgram = 0;
 				}
@@ -291,23 +263,23 @@ ProgramRunStateEnum V16N29ShowIMUGyro(ProgramCallStateEnum call)
  */
 void V16N30ThreadCallback(void)
 {
+		SevenSegmentDisplayStruct* displayData;
 		VectorInt16 rawData = GetAcelRaw();
 		if(ActiveProgram != 3)
 		{
 				return;
 		}
 
-		PositionProgramDisplayData.R1 = rawData.x;
-		PositionProgramDisplayData.R2 = rawData.y;
-		PositionProgramDisplayData.R3 = rawData.z;
+		displayData = SevenSegmentBeginFrame(&PositionProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, rawData.x, 0x3F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, rawData.y, 0x3F);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, rawData.z, 0x3F);
 
 
-		PositionProgramDisplayData.Verb = 16;
-		PositionProgramDisplayData.Noun = 30;
-		PositionProgramDisplayData.Prog = 0;
-		PositionProgramDisplayData.R1DigitShowMask = 0x3F;
-		PositionProgramDisplayData.R2DigitShowMask = 0x3F;
-		PositionProgramDisplayData.R3DigitShowMask = 0x3F;
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(30);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		SevenSegmentPublishFrame(&PositionProgramFrame);
 
 		NeoPixelSetState(VERB_PIXEL,GREEN_COLOUR,PIXEL_ON);
 		NeoPixelSetState(NOUN_PIXEL,GREEN_COLOUR,PIXEL_ON);
@@ -332,10 +304,11 @@ ProgramRunStateEnum V16N30ShowIMUAcel(ProgramCallStateEnum call)
 				/* Check if the thread already exists before we try to create it. */
 				if(V16N30Thread == NULL)
 				{
-						V16N30Thread = new Thread();
-						V16N30Thread->onRun(V16N30ThreadCallback);
-						V16N30Thread->setInterval(100);
-						controll.add(V16N30Thread);
+						V16N30Thread = ThreadPoolAcquire(V16N30ThreadCallback, 100);
+						if(V16N30Thread == NULL)
+						{
+								return NOT_RUNNING;
+						}
 						ActiveProgram = 3;
 						return FOREGROUND;
 				}
@@ -368,8 +341,7 @@ ProgramRunStateEnum V16N30ShowIMUAcel(ProgramCallStateEnum call)
 				{
 						ActiveProgram = 0;
 						NeoPixelSetState(TRACKER_PIXEL,WARM_WHITE_COLOUR,PIXEL_OFF);
-						controll.remove(V16N30Thread);
-						delete[] V16N30Thread;
+						ThreadPoolRelease(V16N30Thread);
 						V16N30Thread = NULL;
 				}
 				return NOT_RUNNING;
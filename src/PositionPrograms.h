@@ -24,7 +24,7 @@
  #define POSITION_PROGRAM_H
 
 
-extern SevenSegmentDisplayStruct* PositionGetDisplayData(void);
+extern const SevenSegmentDisplayStruct* PositionGetDisplayData(void);
 extern void V16N43ThreadCallback(void);
 extern ProgramRunStateEnum V16N43ShowGPSPosition(ProgramCallStateEnum call);
 
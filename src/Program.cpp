@@ -24,7 +24,6 @@
  */
 #include <Wire.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 
 /* Open DSKY headers */
@@ -33,10 +32,13 @@
 #include "DiagnosticPrograms.h"
 #include "TimePrograms.h"
 #include "PositionPrograms.h"
+#include "Scheduler.h"
 #include "main.h"
 #include "Launch.h"
+#include "Latency.h"
 
 #define MAX_NUMBER_ENTRIES 10
+#define NO_PROGRAM         0xFFU
 #define DEBUG
 typedef enum KEYBOARD_MODE_EMUM
 {
@@ -56,43 +58,359 @@ typedef enum KEYBOARD_INT_ENUM
 }KeyboardIntEnum;
 
 static KeyboardIntEnum keyboardInt;
-static KeysEnum pressedKey;
 static uint32_t numberEntry;
 static int32_t verb;
 static int32_t noun;
 static uint8_t numberIdx;
+static uint8_t entryDigits;
 static bool minusPressed = false;
 static KeybordModeEnum keyboardMode;
 
-/* This structure contains all of the programs in the system. The noun number is
+/* This table contains all of the programs in the system. The noun number is
    optional. The program function is called when the verb and noun are entered. if
    the program should be called repeatedly, then you will need to setup a thread
    and callback function inside the program function. The set data function is
    used to give numerial data to the function. The Get Disp Data Function Should
-   return display data for the 7 segment display driver. Run State is used internally
-   by the Program module to track the state of all of the current programs.*/
-ProgramStruct ProgramTable[] =
-{
-		/*verb  noun       Program Function        Set Data Function    Get Disp Data Function   Run State     Description */
-		{ 35,  NOT_USED,  &V35BulbTest,             NULL,                &DiagnosticGetDisplayData,    NOT_RUNNING}, /* Bulb test */
-		{ 30,  NOT_USED,  &V30BringToForeground,    &V30GiveData,        NULL,                    NOT_RUNNING}, /* Bring To foreground */
-		{ 34,  NOT_USED,  &V34Terminate,            NULL,                NULL,                    NOT_RUNNING}, /* Terminate Program */
-		{ 32,  NOT_USED,  &V32Reset,                NULL,                NULL,                    NOT_RUNNING}, /* Reset Program */
-		{ 37,  36,        &V37N36SetAlarmProg,      &V37N36GiveData,     &TimeGetDisplayData,     NOT_RUNNING}, /* Set Alarm Program */
-		{ 16,  36,        &V16N36ShowRTCTime,       NULL,                &TimeGetDisplayData,     NOT_RUNNING}, /* Show RTC Time on 7 segment */
-		{ 25,  36,        &V25N36LoadManualTime,    &V25N36GiveData,     &TimeGetDisplayData,     NOT_RUNNING}, /* Set RTC manually */
-		{ 26,  36,        &V26N36LoadGPSTime,       &V26N36GiveData,     &TimeGetDisplayData,     NOT_RUNNING}, /* Set RTC from GPS */
-		{ 16,  43,        &V16N43ShowGPSPosition,   NULL,                &PositionGetDisplayData, NOT_RUNNING}, /* Show GPS poistion Data */
-		{ 16,  29,        &V16N29ShowIMUGyro,       NULL,                &PositionGetDisplayData, NOT_RUNNING}, /* Show IMU Gyro Data */
-		{ 16,  30,        &V16N30ShowIMUAcel,       NULL,                &PositionGetDisplayData, NOT_RUNNING}, /* Show IMU Acceloromter Data */
-		{ 21,  98,        &V21N98SoundTest,         &V21N98GiveData,     NULL,                    NOT_RUNNING}, /* Sound test */
-		{ 37,  02,        &V37N02Launch,            &V37N02GiveData,     &LaunchGetDisplayData,   NOT_RUNNING},  /* Launch Program */
-		{ 16,  62,        &V37N02Launch,            NULL,                &LaunchGetDisplayData,   NOT_RUNNING},  /* Launch Program  v/a/h*/
-		{ 16,  65,        &V16N65Launch,            NULL,                &LaunchGetDisplayData,   NOT_RUNNING}  /* Monitor Time Since Launch*/
+   return display data for the 7 segment display driver. The table is read only
+   and lives in flash, the run state of each program is tracked separately.
+
+   The table is expanded twice, once into ProgramTable[] and once into the
+   compile time verb/noun keys used to build the program hash table below, so
+   every verb/noun pair must be unique. */
+#define PROGRAM_TABLE(ENTRY) \
+		/*    verb  noun       Program Function        Set Data Function    Get Disp Data Function       Description */ \
+		ENTRY( 35,  NOT_USED,  &V35BulbTest,             NULL,                &DiagnosticGetDisplayData) /* Bulb test */ \
+		ENTRY( 30,  NOT_USED,  &V30BringToForeground,    &V30GiveData,        NULL)                      /* Bring To foreground */ \
+		ENTRY( 34,  NOT_USED,  &V34Terminate,            NULL,                NULL)                      /* Terminate Program */ \
+		ENTRY( 32,  NOT_USED,  &V32Reset,                NULL,                NULL)                      /* Reset Program */ \
+		ENTRY( 37,  36,        &V37N36SetAlarmProg,      &V37N36GiveData,     &TimeGetDisplayData)       /* Set Alarm Program */ \
+		ENTRY( 16,  36,        &V16N36ShowRTCTime,       NULL,                &TimeGetDisplayData)       /* Show RTC Time on 7 segment */ \
+		ENTRY( 25,  36,        &V25N36LoadManualTime,    &V25N36GiveData,     &TimeGetDisplayData)       /* Set RTC manually */ \
+		ENTRY( 26,  36,        &V26N36LoadGPSTime,       &V26N36GiveData,     &TimeGetDisplayData)       /* Set RTC from GPS */ \
+		ENTRY( 16,  43,        &V16N43ShowGPSPosition,   NULL,                &PositionGetDisplayData)   /* Show GPS poistion Data */ \
+		ENTRY( 16,  29,        &V16N29ShowIMUGyro,       NULL,                &PositionGetDisplayData)   /* Show IMU Gyro Data */ \
+		ENTRY( 16,  30,        &V16N30ShowIMUAcel,       NULL,                &PositionGetDisplayData)   /* Show IMU Acceloromter Data */ \
+		ENTRY( 21,  98,        &V21N98SoundTest,         &V21N98GiveData,     NULL)                      /* Sound test */ \
+		ENTRY( 37,  02,        &V37N02Launch,            &V37N02GiveData,     &LaunchGetDisplayData)     /* Launch Program */ \
+		ENTRY( 16,  62,        &V37N02Launch,            NULL,                &LaunchGetDisplayData)     /* Launch Program  v/a/h*/ \
+		ENTRY( 16,  65,        &V16N65Launch,            NULL,                &LaunchGetDisplayData)     /* Monitor Time Since Launch*/ \
+		ENTRY( 16,  97,        &V16N97ShowThreadPool,    NULL,                &DiagnosticGetDisplayData) /* Thread pool occupancy */ \
+		ENTRY( 16,  96,        &V16N96ShowIdle,          NULL,                &DiagnosticGetDisplayData) /* Idle residency */ \
+		ENTRY( 16,  95,        &V16N95ShowLoad,          NULL,                &DiagnosticGetDisplayData) /* Scheduler load */ \
+		ENTRY( 25,  94,        &V25N94CalibrateKeyboard, NULL,                &DiagnosticGetDisplayData) /* Keyboard calibration */ \
+		ENTRY( 16,  93,        &V16N93ShowLatency,       NULL,                &DiagnosticGetDisplayData) /* Key press to display latency */ \
+		ENTRY( 16,  92,        &V16N92ShowBusContention, NULL,                &DiagnosticGetDisplayData) /* Neopixel and GPS contention */
+
+#define PROGRAM_TABLE_ENTRY(verbNumber, nounNumber, program, setData, getDisplayData) \
+		{ verbNumber, nounNumber, program, setData, getDisplayData },
+
+const ProgramStruct ProgramTable[] PROGMEM =
+{
+		PROGRAM_TABLE(PROGRAM_TABLE_ENTRY)
 };
 
 #define NUM_PROG_TABLE_ENTRIES  (sizeof(ProgramTable)/sizeof(ProgramStruct))
 
+/* The run state of every program is kept as one bit per program table entry
+   in the FOREGROUND and BACKGROUND masks (a program in neither is NOT_RUNNING).
+   Only one program can be in the foreground, its index is also kept so that
+   finding it doesn't need a search. */
+typedef uint32_t ProgramMaskType;
+static ProgramMaskType programForegroundMask = 0U;
+static ProgramMaskType programBackgroundMask = 0U;
+static uint8_t programForegroundIdx = NO_PROGRAM;
+
+static void ProgramSetRunState(uint8_t idx, ProgramRunStateEnum state);
+static void ProgramHandleKey(KeysEnum key);
+static void ProgramHandleChord(KeysEnum key, KeysEnum chord);
+static void ProgramEchoEntry(void);
+
+/* Verb/noun lookups go through a perfect hash that is generated at compile time
+   from PROGRAM_TABLE, so finding a program costs the same however big the table
+   gets. Verbs and nouns are packed into a 14 bit key (verb in the top 7 bits,
+   noun + 1 in the bottom 7 so that NOT_USED maps to 0), which is then spread
+   over PROGRAM_HASH_SIZE slots with a multiplicative hash. If adding a program
+   trips the collision static_assert below, change PROGRAM_HASH_MULTIPLIER (any
+   odd value that passes will do) or increase PROGRAM_HASH_BITS. */
+#define PROGRAM_HASH_BITS           6U
+#define PROGRAM_HASH_SIZE           (1U << PROGRAM_HASH_BITS)
+#define PROGRAM_HASH_MULTIPLIER     40441UL
+#define PROGRAM_KEY_MAX_VERB        127
+#define PROGRAM_KEY_MAX_NOUN        126
+
+static constexpr uint16_t ProgramKey(int32_t verbNumber, int32_t nounNumber)
+{
+		return (uint16_t)((verbNumber << 7) + (nounNumber + 1));
+}
+
+static constexpr uint8_t ProgramHash(uint16_t key)
+{
+		return (uint8_t)((uint16_t)((uint32_t)key * PROGRAM_HASH_MULTIPLIER) >> (16U - PROGRAM_HASH_BITS));
+}
+
+#define PROGRAM_KEY_ENTRY(verbNumber, nounNumber, program, setData, getDisplayData) \
+		ProgramKey(verbNumber, nounNumber),
+
+static constexpr uint16_t ProgramKeys[] =
+{
+		PROGRAM_TABLE(PROGRAM_KEY_ENTRY)
+};
+
+/* true if any entry from otherIdx onwards matches the key (or the hash) of idx */
+static constexpr bool ProgramKeyRepeated(uint8_t idx, uint8_t otherIdx, bool compareHash)
+{
+		return (otherIdx >= NUM_PROG_TABLE_ENTRIES) ? false :
+		       ((compareHash ? (ProgramHash(ProgramKeys[idx]) == ProgramHash(ProgramKeys[otherIdx]))
+		                     : (ProgramKeys[idx] == ProgramKeys[otherIdx])) ||
+		        ProgramKeyRepeated(idx, otherIdx + 1U, compareHash));
+}
+
+static constexpr bool ProgramKeysRepeated(uint8_t idx, bool compareHash)
+{
+		return (idx >= NUM_PROG_TABLE_ENTRIES) ? false :
+		       (ProgramKeyRepeated(idx, idx + 1U, compareHash) || ProgramKeysRepeated(idx + 1U, compareHash));
+}
+
+/* index of the program that hashes to slot, or NO_PROGRAM if the slot is empty */
+static constexpr uint8_t ProgramHashSlot(uint8_t slot, uint8_t idx)
+{
+		return (idx >= NUM_PROG_TABLE_ENTRIES) ? NO_PROGRAM :
+		       ((ProgramHash(ProgramKeys[idx]) == slot) ? idx : ProgramHashSlot(slot, idx + 1U));
+}
+
+/* bit mask of every verb in the byte of verbs starting at verbBase */
+static constexpr uint8_t ProgramVerbBits(uint8_t verbBase, uint8_t idx)
+{
+		return (idx >= NUM_PROG_TABLE_ENTRIES) ? 0U :
+		       (uint8_t)((((ProgramKeys[idx] >> 7) - verbBase) < 8U ? (1U << ((ProgramKeys[idx] >> 7) - verbBase)) : 0U) |
+		                 ProgramVerbBits(verbBase, idx + 1U));
+}
+
+static_assert(NUM_PROG_TABLE_ENTRIES < NO_PROGRAM, "Too many programs in PROGRAM_TABLE");
+static_assert(NUM_PROG_TABLE_ENTRIES <= (sizeof(ProgramMaskType) * 8U), "Too many programs for ProgramMaskType");
+static_assert(!ProgramKeysRepeated(0U, false), "PROGRAM_TABLE contains a duplicate verb/noun pair");
+static_assert(!ProgramKeysRepeated(0U, true), "PROGRAM_TABLE hash collision, change PROGRAM_HASH_MULTIPLIER");
+static_assert(PROGRAM_HASH_SIZE == 64U, "ProgramHashSlots initialiser expects 64 slots");
+
+#define PROGRAM_HASH_SLOTS_8(slot) \
+		ProgramHashSlot((slot), 0U),      ProgramHashSlot((slot) + 1U, 0U), \
+		ProgramHashSlot((slot) + 2U, 0U), ProgramHashSlot((slot) + 3U, 0U), \
+		ProgramHashSlot((slot) + 4U, 0U), ProgramHashSlot((slot) + 5U, 0U), \
+		ProgramHashSlot((slot) + 6U, 0U), ProgramHashSlot((slot) + 7U, 0U)
+
+static const uint8_t ProgramHashSlots[PROGRAM_HASH_SIZE] PROGMEM =
+{
+		PROGRAM_HASH_SLOTS_8(0U),  PROGRAM_HASH_SLOTS_8(8U),
+		PROGRAM_HASH_SLOTS_8(16U), PROGRAM_HASH_SLOTS_8(24U),
+		PROGRAM_HASH_SLOTS_8(32U), PROGRAM_HASH_SLOTS_8(40U),
+		PROGRAM_HASH_SLOTS_8(48U), PROGRAM_HASH_SLOTS_8(56U)
+};
+
+#define PROGRAM_VERB_BITS_32(verbBase) \
+		ProgramVerbBits((verbBase), 0U),       ProgramVerbBits((verbBase) + 8U, 0U), \
+		ProgramVerbBits((verbBase) + 16U, 0U), ProgramVerbBits((verbBase) + 24U, 0U)
+
+/* One bit per verb, set if any program uses that verb */
+static const uint8_t ProgramVerbMask[(PROGRAM_KEY_MAX_VERB + 1) / 8] PROGMEM =
+{
+		PROGRAM_VERB_BITS_32(0U),  PROGRAM_VERB_BITS_32(32U),
+		PROGRAM_VERB_BITS_32(64U), PROGRAM_VERB_BITS_32(96U)
+};
+
+
+/**
+ * ProgramFind
+ *
+ * Looks up a program by its verb and noun numbers using the compile time hash
+ * table.
+ * @param  verbNumber verb of the program to find
+ * @param  nounNumber noun of the program to find, NOT_USED for verb only programs
+ * @return            index into ProgramTable[], or NO_PROGRAM if not found.
+ */
+static uint8_t ProgramFind(int32_t verbNumber, int32_t nounNumber)
+{
+		uint8_t idx;
+
+		if((verbNumber < 0) || (verbNumber > PROGRAM_KEY_MAX_VERB) ||
+		   (nounNumber < NOT_USED) || (nounNumber > PROGRAM_KEY_MAX_NOUN))
+		{
+				return NO_PROGRAM;
+		}
+
+		idx = pgm_read_byte(&ProgramHashSlots[ProgramHash(ProgramKey(verbNumber, nounNumber))]);
+
+		if((idx != NO_PROGRAM) &&
+		   ((int16_t)pgm_read_word(&ProgramTable[idx].VProgramNumber) == verbNumber) &&
+		   ((int16_t)pgm_read_word(&ProgramTable[idx].NProgramNumber) == nounNumber))
+		{
+				return idx;
+		}
+		return NO_PROGRAM;
+}
+
+
+/**
+ * ProgramVerbKnown
+ *
+ * @param  verbNumber verb to check
+ * @return            true if any program in the table uses this verb.
+ */
+static bool ProgramVerbKnown(int32_t verbNumber)
+{
+		if((verbNumber < 0) || (verbNumber > PROGRAM_KEY_MAX_VERB))
+		{
+				return false;
+		}
+		return (pgm_read_byte(&ProgramVerbMask[verbNumber >> 3]) & (1U << (verbNumber & 7))) != 0U;
+}
+
+
+/**
+ * ProgramRead
+ *
+ * Copies a program table entry out of flash.
+ * @param idx     index into ProgramTable[]
+ * @param program structure to copy the entry into
+ */
+static void ProgramRead(uint8_t idx, ProgramStruct* program)
+{
+		memcpy_P(program, &ProgramTable[idx], sizeof(ProgramStruct));
+}
+
+
+/**
+ * ProgramGetRunState
+ *
+ * @param  idx index into ProgramTable[]
+ * @return     the current ProgramRunStateEnum of the program.
+ */
+static ProgramRunStateEnum ProgramGetRunState(uint8_t idx)
+{
+		ProgramMaskType mask = (ProgramMaskType)1U << idx;
+
+		if((programForegroundMask & mask) != 0U)
+		{
+				return FOREGROUND;
+		}
+		if((programBackgroundMask & mask) != 0U)
+		{
+				return BACKGROUND;
+		}
+		return NOT_RUNNING;
+}
+
+
+/**
+ * ProgramPushToBackground
+ *
+ * Tells a program that it is being pushed to the background, and records the
+ * state it returns. A program that tries to stay in the foreground is treated
+ * as being in the background, so that only one program is ever in the
+ * foreground.
+ * @param idx index into ProgramTable[]
+ */
+static void ProgramPushToBackground(uint8_t idx)
+{
+		ProgramStruct program;
+		ProgramRunStateEnum state = BACKGROUND;
+
+		ProgramRead(idx, &program);
+		if(program.Program != NULL)
+		{
+				state = program.Program(PUSH_PROGRAM_TO_BACKGROUND);
+		}
+		ProgramSetRunState(idx, (state == FOREGROUND) ? BACKGROUND : state);
+}
+
+
+/**
+ * ProgramSetRunState
+ *
+ * Records the run state returned by a program. As only one program can be in
+ * the foreground, if a program takes over the foreground then whichever
+ * program was there before is pushed to the background.
+ * @param idx   index into ProgramTable[]
+ * @param state the new ProgramRunStateEnum of the program.
+ */
+static void ProgramSetRunState(uint8_t idx, ProgramRunStateEnum state)
+{
+		ProgramMaskType mask = (ProgramMaskType)1U << idx;
+		uint8_t previousIdx = programForegroundIdx;
+
+		programForegroundMask &= ~mask;
+		programBackgroundMask &= ~mask;
+
+		if(state == FOREGROUND)
+		{
+				programForegroundMask |= mask;
+				programForegroundIdx = idx;
+				if((previousIdx != NO_PROGRAM) && (previousIdx != idx))
+				{
+						ProgramPushToBackground(previousIdx);
+				}
+		}
+		else
+		{
+				if(state == BACKGROUND)
+				{
+						programBackgroundMask |= mask;
+				}
+				if(previousIdx == idx)
+				{
+						programForegroundIdx = NO_PROGRAM;
+				}
+		}
+
+		/* The display shows the foreground program, so redraw it if that changed */
+		if(programForegroundIdx != previousIdx)
+		{
+				SevenSegmentRequestRefresh();
+		}
+}
+
+
+/**
+ * ProgramCall
+ *
+ * Calls the program with the given call state, and records the state it
+ * returns.
+ * @param idx  index into ProgramTable[]
+ * @param call ProgramCallStateEnum to give to the program.
+ * @return     true if the program could be called.
+ */
+static bool ProgramCall(uint8_t idx, ProgramCallStateEnum call)
+{
+		ProgramStruct program;
+
+		ProgramRead(idx, &program);
+		if(program.Program != NULL)
+		{
+				ProgramSetRunState(idx, program.Program(call));
+				return true;
+		}
+		return false;
+}
+
+
+/**
+ * ProgramBringToForeground
+ *
+ * Pushes whichever program is currently in the foreground to the background,
+ * then gives the call state to the new program.
+ * @param idx  index into ProgramTable[] of the new program
+ * @param call ProgramCallStateEnum to give to the new program.
+ * @return     true if the program could be called.
+ */
+static bool ProgramBringToForeground(uint8_t idx, ProgramCallStateEnum call)
+{
+		if((programForegroundIdx != NO_PROGRAM) && (programForegroundIdx != idx))
+		{
+				ProgramPushToBackground(programForegroundIdx);
+		}
+		return ProgramCall(idx, call);
+}
+
+
 /**
  * GiveVerbToProgram
  *
@@ -103,26 +421,25 @@ ProgramStruct ProgramTable[] =
  */
 bool GiveVerbToProgram(int16_t newVerb)
 {
-		uint16_t idx = 0;
+		uint8_t idx;
 		bool found = false;
 #ifdef DEBUG
 		Serial.print("verb number is ");
 		Serial.println(newVerb);
 #endif
-		/* search through the program table to see if this verb is related to a
-		   program, or whether it should be given to the currenty running program */
-		while (( idx< NUM_PROG_TABLE_ENTRIES) && (!found))
+		/* check whether this verb is related to a program, verb only programs are
+		   started straight away, otherwise we wait for the noun. Verb only programs
+		   (e.g. V34 terminate) may act on the program in the foreground, so it is
+		   only pushed to the background if the verb program takes its place. */
+		if(ProgramVerbKnown(newVerb))
 		{
-				if(ProgramTable[idx].VProgramNumber == newVerb)
+				found = true;
+				verb = newVerb;
+				idx = ProgramFind(newVerb, NOT_USED);
+				if(idx != NO_PROGRAM)
 				{
-						found = true;
-						verb = newVerb;
-						if(ProgramTable[idx].NProgramNumber < 0)
-						{
-								ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(BRING_PROGRAM_TO_FOREGROUND);
-						}
+						(void)ProgramCall(idx, BRING_PROGRAM_TO_FOREGROUND);
 				}
-				idx++;
 		}
 
 		return found;
@@ -139,27 +456,17 @@ bool GiveVerbToProgram(int16_t newVerb)
  */
 bool GiveNounToProgram(int16_t newNoun)
 {
-		uint16_t idx = 0;
+		uint8_t idx = ProgramFind(verb, newNoun);
 		bool found = false;
 #ifdef DEBUG
 		Serial.print("noun number is ");
 		Serial.println(newNoun);
 #endif
-		/* search through the program table to see if this verb is related to a
-		     program, or whether it should be given to the currenty running program */
-		while (( idx< NUM_PROG_TABLE_ENTRIES) && (!found))
+		if(idx != NO_PROGRAM)
 		{
-				if((ProgramTable[idx].VProgramNumber == verb) &&
-				   (ProgramTable[idx].NProgramNumber == newNoun))
-				{
-						found = true;
-						noun = newNoun;
-						if(ProgramTable[idx].Program != NULL)
-						{
-								ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(BRING_PROGRAM_TO_FOREGROUND);
-						}
-				}
-				idx++;
+				found = true;
+				noun = newNoun;
+				(void)ProgramBringToForeground(idx, BRING_PROGRAM_TO_FOREGROUND);
 		}
 
 
@@ -177,30 +484,29 @@ bool GiveNounToProgram(int16_t newNoun)
  */
 bool GiveNumbersToProgram(int32_t number)
 {
-		uint16_t idx = 0;
+		uint8_t idx = programForegroundIdx;
 		bool found = false;
+		ProgramStruct program;
 
-
-		while (!found && (  idx < NUM_PROG_TABLE_ENTRIES))
+		if(idx != NO_PROGRAM)
 		{
-				if((ProgramTable[idx].CurrentRunState == FOREGROUND) &&
-				   (ProgramTable[idx].SetData != NULL))
+				ProgramRead(idx, &program);
+				if(program.SetData != NULL)
 				{
-						ProgramTable[idx].CurrentRunState = ProgramTable[idx].SetData(numberIdx, number);
+						ProgramSetRunState(idx, program.SetData(numberIdx, number));
 						found = true;
 
 #ifdef DEBUG
 						Serial.print("Send Data to:V");
-						Serial.print(ProgramTable[idx].VProgramNumber);
+						Serial.print(program.VProgramNumber);
 						Serial.print("N");
-						Serial.print(ProgramTable[idx].NProgramNumber);
+						Serial.print(program.NProgramNumber);
 						Serial.print(" I ");
 						Serial.print(numberIdx);
 						Serial.print(" D ");
 						Serial.println(number);
 #endif
 				}
-				idx++;
 		}
 
 		return found;
@@ -209,121 +515,235 @@ bool GiveNumbersToProgram(int32_t number)
 /**
  * ProgramTask
  *
- * Takes the keys from the keyboard, and works out what to do with the keypresses
- * It then uses the other functions in this module to send the data to the
- * correct program.
+ * Takes all of the queued key events from the keyboard, and works out what to
+ * do with the keypresses. Draining the whole queue every loop means that keys
+ * typed ahead whilst the loop was busy are never lost.
  */
 void ProgramTask(void)
 {
-		KeysEnum temporaryKey = GetPressedKey();
+		KeyEventStruct keyEvent;
 
-		if(pressedKey != temporaryKey)
+		while(KeyboardGetEvent(&keyEvent))
 		{
-				switch(temporaryKey)
+				/* only the digits repeat, so a held key types the same digit
+				   again, repeating the other keys would end the entry */
+				if((keyEvent.Type == KEY_PRESSED) ||
+				   ((keyEvent.Type == KEY_REPEAT) && (keyEvent.Key <= KEY_9)))
 				{
-				case KEY_CLEAR:
-						/* clear resets the current number entry */
-						numberIdx = 0;
-						break;
-
-				case KEY_VERB:
-						/* Enter verb mode */
-						keyboardMode = VERB_ENTRY;
-						numberEntry = 0U;
-						numberIdx = 0U;
-						keyboardInt = OCTAL;
-						break;
-
-				case KEY_NOUN:
-						/* if entering a noun, give the previous verb to a program */
-						if(keyboardMode == VERB_ENTRY)
+						if(keyEvent.Type == KEY_PRESSED)
 						{
-								verb = numberEntry;
-								numberEntry = 0U;
-								/* Enter noun mode */
-								keyboardMode = NOUN_ENTRY;
-								numberIdx = 0U;
-								(void)GiveVerbToProgram(verb);
+								LatencyKeyConsumed(&keyEvent);
 						}
-						break;
+						ProgramHandleKey((KeysEnum)keyEvent.Key);
+						LatencyMark(LATENCY_HANDLED);
+						/* show the effect of the key straight away */
+						SevenSegmentRequestRefresh();
+				}
+				else if(keyEvent.Type == KEY_CHORD)
+				{
+						ProgramHandleChord((KeysEnum)keyEvent.Key, (KeysEnum)keyEvent.Chord);
+						SevenSegmentRequestRefresh();
+				}
+		}
+}
 
-				case KEY_ENTER:
-						if(keyboardMode == VERB_ENTRY)
-						{
-								/* Enter with just a verb gives the verb to a program */
-								verb = numberEntry;
-								numberEntry = 0U;
-								numberIdx = 0U;
-								(void)GiveVerbToProgram(verb);
-						}
-						else if(keyboardMode == NOUN_ENTRY)
+
+/**
+ * ProgramHandleChord
+ *
+ * Works out what to do with two keys held together. CLR and RSET together
+ * throw away whatever is being typed and reset the program in the foreground.
+ * @param key   the key that was held first
+ * @param chord the key that was pressed with it
+ */
+static void ProgramHandleChord(KeysEnum key, KeysEnum chord)
+{
+		if(((key == KEY_CLEAR) && (chord == KEY_RESET)) ||
+		   ((key == KEY_RESET) && (chord == KEY_CLEAR)))
+		{
+				keyboardMode = NO_ENTRY;
+				numberIdx = 0;
+				numberEntry = 0U;
+				entryDigits = 0U;
+				keyboardInt = OCTAL;
+				SevenSegmentEchoClear();
+				(void)V32Reset(START_PROGRAM);
+		}
+}
+
+
+/**
+ * ProgramHandleKey
+ *
+ * Works out what to do with a keypress. It then uses the other functions in
+ * this module to send the data to the correct program.
+ * @param key the key that has been pressed
+ */
+static void ProgramHandleKey(KeysEnum key)
+{
+		switch(key)
+		{
+		case KEY_CLEAR:
+				/* clear resets the current number entry */
+				numberIdx = 0;
+				numberEntry = 0U;
+				entryDigits = 0U;
+				SevenSegmentEchoClear();
+				break;
+
+		case KEY_VERB:
+				/* Enter verb mode */
+				keyboardMode = VERB_ENTRY;
+				numberEntry = 0U;
+				numberIdx = 0U;
+				entryDigits = 0U;
+				keyboardInt = OCTAL;
+				SevenSegmentEchoClear();
+				break;
+
+		case KEY_NOUN:
+				/* if entering a noun, give the previous verb to a program */
+				if(keyboardMode == VERB_ENTRY)
+				{
+						verb = numberEntry;
+						numberEntry = 0U;
+						/* Enter noun mode */
+						keyboardMode = NOUN_ENTRY;
+						numberIdx = 0U;
+						entryDigits = 0U;
+						(void)GiveVerbToProgram(verb);
+				}
+				break;
+
+		case KEY_ENTER:
+				/* the entry is finished, so stop echoing it */
+				entryDigits = 0U;
+				SevenSegmentEchoClear();
+				if(keyboardMode == VERB_ENTRY)
+				{
+						/* Enter with just a verb gives the verb to a program */
+						verb = numberEntry;
+						numberEntry = 0U;
+						numberIdx = 0U;
+						(void)GiveVerbToProgram(verb);
+				}
+				else if(keyboardMode == NOUN_ENTRY)
+				{
+						/* Enter after a noun gives the noun to a program */
+						noun = numberEntry;
+						numberEntry = 0U;
+						numberIdx = 0U;
+						(void)GiveNounToProgram(noun);
+				}
+				else if(keyboardMode == NUMBER_ENTRY)
+				{
+						/* Otherwise in number entry mode */
+						if(!GiveNumbersToProgram(numberEntry))
 						{
-								/* Enter after a noun gives the noun to a program */
-								noun = numberEntry;
-								numberEntry = 0U;
+								keyboardMode = NO_ENTRY;
 								numberIdx = 0U;
-								(void)GiveNounToProgram(noun);
-						}
-						else if(keyboardMode == NUMBER_ENTRY)
-						{
-								/* Otherwise in number entry mode */
-								if(!GiveNumbersToProgram(numberEntry))
-								{
-										keyboardMode = NO_ENTRY;
-										numberIdx = 0U;
-								}
-								else
-								{
-										numberIdx++;
-								}
-								numberEntry = 0U;
 						}
 						else
 						{
-								numberEntry = 0U;
+								numberIdx++;
 						}
-						keyboardMode = NUMBER_ENTRY;
-						break;
-
-				case KEY_0:
-				case KEY_1:
-				case KEY_2:
-				case KEY_3:
-				case KEY_4:
-				case KEY_5:
-				case KEY_6:
-				case KEY_7:
-				case KEY_8:
-				case KEY_9:
-						numberEntry*=10;
-						numberEntry+=(int32_t)temporaryKey;
-						if((minusPressed) && (numberEntry > 0))
-						{
-								numberEntry*=-1;
-								minusPressed = false;
-						}
-						break;
+						numberEntry = 0U;
+						keyboardInt = OCTAL;
+				}
+				else
+				{
+						numberEntry = 0U;
+				}
+				keyboardMode = NUMBER_ENTRY;
+				break;
+
+		case KEY_0:
+		case KEY_1:
+		case KEY_2:
+		case KEY_3:
+		case KEY_4:
+		case KEY_5:
+		case KEY_6:
+		case KEY_7:
+		case KEY_8:
+		case KEY_9:
+				numberEntry*=10;
+				numberEntry+=(int32_t)key;
+				if(entryDigits < SEVEN_SEGMENT_REGISTER_DIGITS)
+				{
+						entryDigits++;
+				}
+				if((minusPressed) && (numberEntry > 0))
+				{
+						numberEntry*=-1;
+						minusPressed = false;
+				}
+				break;
+
+		case KEY_MINUS:
+				if(numberEntry >0)
+				{
+						numberEntry*=-1;
+				}
+				else
+				{
+						keyboardInt = NEGATIVE_DECMIAL;
+				}
+				break;
+
+		case KEY_PLUS:
+				keyboardInt = POSITIVE_DECIMAL;
+				break;
+
+		default:
+				break;
+		}
+
+		ProgramEchoEntry();
+}
+
+
+/**
+ * ProgramEchoEntry
+ *
+ * Shows the verb, noun or number being typed on the display as each key is
+ * pressed. Numbers go into R1, R2 and R3 in turn, as the program asks for
+ * them.
+ */
+static void ProgramEchoEntry(void)
+{
+		int32_t value = (int32_t)numberEntry;
+		char sign = ' ';
+
+		switch(keyboardMode)
+		{
+		case VERB_ENTRY:
+				SevenSegmentEcho(SEVEN_SEGMENT_VERB, value, min(entryDigits, 2U), ' ');
+				break;
 
-				case KEY_MINUS:
-						if(numberEntry >0)
+		case NOUN_ENTRY:
+				SevenSegmentEcho(SEVEN_SEGMENT_VERB, verb, 2U, ' ');
+				SevenSegmentEcho(SEVEN_SEGMENT_NOUN, value, min(entryDigits, 2U), ' ');
+				break;
+
+		case NUMBER_ENTRY:
+				if(entryDigits > 0U)
+				{
+						if((value < 0) || (keyboardInt == NEGATIVE_DECMIAL))
 						{
-								numberEntry*=-1;
+								sign = '-';
 						}
-						else
+						else if(keyboardInt == POSITIVE_DECIMAL)
 						{
-								keyboardInt = NEGATIVE_DECMIAL;
+								sign = '+';
 						}
-						break;
-
-				case KEY_PLUS:
-						keyboardInt = POSITIVE_DECIMAL;
-						break;
-
-				default:
-						break;
+						SevenSegmentEcho((SevenSegmentFieldEnum)(SEVEN_SEGMENT_R1 + (numberIdx % 3U)), value, entryDigits, sign);
 				}
+				break;
+
+		default:
+				break;
 		}
-		pressedKey = temporaryKey;
 }
 
 
@@ -331,8 +751,10 @@ void ProgramTask(void)
  * SetProgram
  *
  * Sets the state of the program specifed by the verb and noun numbers. It will
- * search through the program table to find a matching verb noun combo before
- * actioning the request. The noun can be -1 if it is to be ignored.
+ * look up the matching verb noun combo in the program table before actioning
+ * the request. The noun can be -1 if it is to be ignored. If the program is
+ * being started or brought to the foreground, then whatever was in the
+ * foreground is pushed to the background first.
  * @param  verbNumber verb of the program to set
  * @param  nounNumber noun of the program to set (can be -1 to be ignored)
  * @param  callState  ProgramCallStateEnum to give to the program.
@@ -340,42 +762,20 @@ void ProgramTask(void)
  */
 bool SetProgram(int16_t verbNumber, int16_t nounNumber, ProgramCallStateEnum callState)
 {
-		bool newForeground = false;
-		bool found = false;
+		uint8_t idx = ProgramFind(verbNumber, nounNumber);
 
-		if((callState == BRING_PROGRAM_TO_FOREGROUND) ||
-		   (callState == START_PROGRAM) )
+		if(idx == NO_PROGRAM)
 		{
-				newForeground = true;
+				return false;
 		}
 
-		for (uint16_t idx = 0; idx< NUM_PROG_TABLE_ENTRIES; idx++)
+		if((callState == BRING_PROGRAM_TO_FOREGROUND) ||
+		   (callState == START_PROGRAM) )
 		{
-				if((ProgramTable[idx].VProgramNumber == verbNumber) && (ProgramTable[idx].NProgramNumber == nounNumber))
-				{
-
-						if(ProgramTable[idx].Program != NULL )
-						{
-								ProgramTable[idx].CurrentRunState =  ProgramTable[idx].Program(callState);
-								found = true;
-						}
-				}
-				/* push the old foreground program to the background */
-				else if((ProgramTable[idx].CurrentRunState == FOREGROUND) && newForeground)
-				{
-						if(ProgramTable[idx].Program != NULL )
-						{
-								ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(PUSH_PROGRAM_TO_BACKGROUND);
-						}
-				}
-				else
-				{
-						/* do nothing */
-				}
-
+				return ProgramBringToForeground(idx, callState);
 		}
 
-		return found;
+		return ProgramCall(idx, callState);
 }
 
 
@@ -385,20 +785,17 @@ bool SetProgram(int16_t verbNumber, int16_t nounNumber, ProgramCallStateEnum cal
  * @return  This returns a pointer to the display data for whichever program is
  * currently in the FOREGROUND.
  */
-SevenSegmentDisplayStruct* ProgramGetDisplayData(void)
+const SevenSegmentDisplayStruct* ProgramGetDisplayData(void)
 {
-		uint16_t idx = 0;
-		bool found = false;
+		const SevenSegmentDisplayStruct* (*getDisplayData)(void);
 
-
-		while (  idx < NUM_PROG_TABLE_ENTRIES)
+		if(programForegroundIdx != NO_PROGRAM)
 		{
-				if((ProgramTable[idx].CurrentRunState == FOREGROUND) &&
-				   (ProgramTable[idx].GetDisplayData != NULL))
+				getDisplayData = (const SevenSegmentDisplayStruct* (*)(void))pgm_read_ptr(&ProgramTable[programForegroundIdx].GetDisplayData);
+				if(getDisplayData != NULL)
 				{
-						return ProgramTable[idx].GetDisplayData();
+						return getDisplayData();
 				}
-				idx++;
 		}
 
 		return NULL;
@@ -415,16 +812,9 @@ SevenSegmentDisplayStruct* ProgramGetDisplayData(void)
  */
 ProgramRunStateEnum V32Reset(ProgramCallStateEnum call)
 {
-		uint16_t idx = 0;
-
-		while (  idx < NUM_PROG_TABLE_ENTRIES)
+		if(programForegroundIdx != NO_PROGRAM)
 		{
-				if(ProgramTable[idx].CurrentRunState == FOREGROUND)
-				{
-						ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(RESET_PROGRAM);
-						return NOT_RUNNING;
-				}
-				idx++;
+				(void)ProgramCall(programForegroundIdx, RESET_PROGRAM);
 		}
 
 		return NOT_RUNNING;
@@ -441,16 +831,9 @@ ProgramRunStateEnum V32Reset(ProgramCallStateEnum call)
  */
 ProgramRunStateEnum V34Terminate(ProgramCallStateEnum call)
 {
-		uint16_t idx = 0;
-
-		while (  idx < NUM_PROG_TABLE_ENTRIES)
+		if(programForegroundIdx != NO_PROGRAM)
 		{
-				if(ProgramTable[idx].CurrentRunState == FOREGROUND)
-				{
-						ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(STOP_PROGRAM);
-						return NOT_RUNNING;
-				}
-				idx++;
+				(void)ProgramCall(programForegroundIdx, STOP_PROGRAM);
 		}
 
 		return NOT_RUNNING;
@@ -467,16 +850,9 @@ ProgramRunStateEnum V34Terminate(ProgramCallStateEnum call)
  */
 ProgramRunStateEnum V30BringToForeground(ProgramCallStateEnum call)
 {
-		uint16_t idx = 0;
-
-		while (  idx < NUM_PROG_TABLE_ENTRIES)
+		if(programForegroundIdx != NO_PROGRAM)
 		{
-				if(ProgramTable[idx].CurrentRunState == FOREGROUND)
-				{
-						ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(BRING_PROGRAM_TO_FOREGROUND);
-						return NOT_RUNNING;
-				}
-				idx++;
+				(void)ProgramCall(programForegroundIdx, BRING_PROGRAM_TO_FOREGROUND);
 		}
 
 		return NOT_RUNNING;
@@ -495,38 +871,29 @@ ProgramRunStateEnum V30BringToForeground(ProgramCallStateEnum call)
 ProgramRunStateEnum V30GiveData(uint8_t dataIdx,int32_t data)
 {
 		static int16_t verb;
-		uint16_t idx = 0;
+		uint8_t idx;
 		if(dataIdx == 0)
 		{
-				while (  idx < NUM_PROG_TABLE_ENTRIES)
+				idx = ProgramFind(data, NOT_USED);
+				if(idx != NO_PROGRAM)
 				{
-						if((ProgramTable[idx].CurrentRunState != FOREGROUND) &&
-						   (ProgramTable[idx].VProgramNumber == data))
+						if(ProgramGetRunState(idx) != FOREGROUND)
 						{
-								if(ProgramTable[idx].NProgramNumber == NOT_USED)
-								{
-										ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(BRING_PROGRAM_TO_FOREGROUND);
-										return NOT_RUNNING;
-								}
-								else
-								{
-										verb = data;
-								}
+								(void)ProgramBringToForeground(idx, BRING_PROGRAM_TO_FOREGROUND);
 						}
-						idx++;
+						return NOT_RUNNING;
+				}
+				else if(ProgramVerbKnown(data))
+				{
+						verb = data;
 				}
 		}
 		else
 		{
-				while (  idx < NUM_PROG_TABLE_ENTRIES)
+				idx = ProgramFind(verb, data);
+				if((idx != NO_PROGRAM) && (ProgramGetRunState(idx) != FOREGROUND))
 				{
-						if((ProgramTable[idx].CurrentRunState != FOREGROUND) &&
-						   (ProgramTable[idx].VProgramNumber == verb) && (ProgramTable[idx].NProgramNumber == data))
-						{
-								ProgramTable[idx].CurrentRunState = ProgramTable[idx].Program(BRING_PROGRAM_TO_FOREGROUND);
-								return NOT_RUNNING;
-						}
-						idx++;
+						(void)ProgramBringToForeground(idx, BRING_PROGRAM_TO_FOREGROUND);
 				}
 		}
 		return NOT_RUNNING;
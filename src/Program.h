@@ -55,20 +55,17 @@ typedef struct PROGRAM_STRUCT
 		int16_t NProgramNumber;
 		ProgramRunStateEnum (*Program)(ProgramCallStateEnum Call);
 		ProgramRunStateEnum (*SetData)(uint8_t DataIdx, int32_t data);
-		SevenSegmentDisplayStruct* (*GetDisplayData)(void);
-		ProgramRunStateEnum CurrentRunState;
-
-
+		const SevenSegmentDisplayStruct* (*GetDisplayData)(void);
 }ProgramStruct;
 
 
-extern ProgramStruct ProgramTable[];
+extern const ProgramStruct ProgramTable[];
 extern void ProgramSetup(void);
 extern void ProgramTask(void);
 extern bool GiveNumbersToProgram(int32_t number);
 extern void ThreadDoNothing(void);
 extern bool SetProgram(int16_t VerbNumber, int16_t NounNumber, ProgramCallStateEnum callState);
-extern SevenSegmentDisplayStruct* ProgramGetDisplayData(void);
+extern const SevenSegmentDisplayStruct* ProgramGetDisplayData(void);
 extern ProgramRunStateEnum V30BringToForeground(ProgramCallStateEnum Call);
 extern ProgramRunStateEnum V34Terminate(ProgramCallStateEnum Call);
 extern ProgramRunStateEnum V32Reset(ProgramCallStateEnum Call);
@@ -28,15 +28,15 @@
 #include <Wire.h>
 #include <RtcDS3231.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 
 #include "Program.h"
 #include "RTC.h"
+#include "Scheduler.h"
 #include "main.h"
 
 
-Thread* rtcThread = new Thread();
+SchedulerThread* rtcThread = new SchedulerThread();
 RtcDS3231<TwoWire> Rtc(Wire);
 
 
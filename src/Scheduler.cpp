@@ -0,0 +1,612 @@
+/*
+ * Scheduler.cpp
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * Deadline ordered replacement for ThreadController. ThreadController asks
+ * every thread if it should run on every loop, this keeps the threads in a
+ * binary min heap ordered by when they next need to run, so when nothing is
+ * due the loop only compares the top of the heap against the time.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <Arduino.h>
+#include <Thread.h>
+
+/* Open DSKY headers */
+#include "Scheduler.h"
+
+static_assert(SCHEDULER_MAX_THREADS < SCHEDULER_NOT_SCHEDULED, "heapIdx must be able to mark a thread as not scheduled");
+
+
+/**
+ * SchedulerThread
+ *
+ * @param callback    function for the thread to run
+ * @param newInterval time in milliseconds between each run
+ */
+SchedulerThread::SchedulerThread(void (*callback)(void), unsigned long newInterval)
+		: Thread(callback, newInterval), scheduler(NULL), heapIdx(SCHEDULER_NOT_SCHEDULED)
+{
+#ifdef SCHEDULER_STATS
+		resetStats();
+#endif
+}
+
+
+/**
+ * setInterval
+ *
+ * Changes the interval, which moves the next deadline, so the thread is
+ * moved to its new place in the scheduler.
+ * @param newInterval time in milliseconds between each run
+ */
+void SchedulerThread::setInterval(unsigned long newInterval)
+{
+		Thread::setInterval(newInterval);
+		if((scheduler != NULL) && (heapIdx != SCHEDULER_NOT_SCHEDULED))
+		{
+				scheduler->Reschedule(heapIdx);
+		}
+}
+
+
+#ifdef SCHEDULER_STATS
+/**
+ * resetStats
+ *
+ * Clears the callback timings and counts.
+ */
+void SchedulerThread::resetStats(void)
+{
+		callCount = 0U;
+		overrunCount = 0U;
+		minTime = 0xFFFFFFFFUL;
+		maxTime = 0UL;
+		totalTime = 0UL;
+}
+
+
+/**
+ * calls
+ *
+ * @return  the number of times the callback has run, this stops at 65535
+ */
+uint16_t SchedulerThread::calls(void)
+{
+		return callCount;
+}
+
+
+/**
+ * overruns
+ *
+ * @return  the number of runs that started at least one interval late
+ */
+uint16_t SchedulerThread::overruns(void)
+{
+		return overrunCount;
+}
+
+
+/**
+ * minMicros
+ *
+ * @return  the shortest callback time in microseconds, 0 if it hasn't run
+ */
+unsigned long SchedulerThread::minMicros(void)
+{
+		return (callCount == 0U) ? 0UL : minTime;
+}
+
+
+/**
+ * avgMicros
+ *
+ * @return  the average callback time in microseconds, 0 if it hasn't run
+ */
+unsigned long SchedulerThread::avgMicros(void)
+{
+		return (callCount == 0U) ? 0UL : (totalTime / callCount);
+}
+
+
+/**
+ * maxMicros
+ *
+ * @return  the longest callback time in microseconds
+ */
+unsigned long SchedulerThread::maxMicros(void)
+{
+		return maxTime;
+}
+#endif
+
+
+/**
+ * Scheduler
+ */
+Scheduler::Scheduler(void) : threadCount(0U)
+{
+#ifdef SCHEDULER_STATS
+		windowStart = 0UL;
+		windowBusy = 0UL;
+		windowLoops = 0U;
+		loadPercent = 0U;
+		loopsPerSecond = 0U;
+		worstTime = 0UL;
+#endif
+}
+
+
+/**
+ * Earlier
+ *
+ * Compares two deadlines in a way that still works when millis() wraps.
+ * @return  true if thread a is due before thread b
+ */
+bool Scheduler::Earlier(SchedulerThread* a, SchedulerThread* b)
+{
+		return (long)(a->_cached_next_run - b->_cached_next_run) < 0L;
+}
+
+
+/**
+ * Due
+ *
+ * @param  thread thread to check
+ * @param  time   current time from millis()
+ * @return        true if the thread's deadline has been reached
+ */
+bool Scheduler::Due(SchedulerThread* thread, unsigned long time)
+{
+		return (long)(time - thread->_cached_next_run) >= 0L;
+}
+
+
+/**
+ * Place
+ *
+ * Puts a thread in a heap slot and tells the thread where it is.
+ * @param idx    heap slot
+ * @param thread thread to put there
+ */
+void Scheduler::Place(uint8_t idx, SchedulerThread* thread)
+{
+		heap[idx] = thread;
+		thread->heapIdx = idx;
+}
+
+
+/**
+ * SiftUp
+ *
+ * Moves a thread towards the top of the heap until its parent is due first.
+ * @param idx heap slot of the thread
+ */
+void Scheduler::SiftUp(uint8_t idx)
+{
+		SchedulerThread* thread = heap[idx];
+
+		while(idx > 0U)
+		{
+				uint8_t parent = (uint8_t)((idx - 1U) / 2U);
+				if(!Earlier(thread, heap[parent]))
+				{
+						break;
+				}
+				Place(idx, heap[parent]);
+				idx = parent;
+		}
+		Place(idx, thread);
+}
+
+
+/**
+ * SiftDown
+ *
+ * Moves a thread towards the bottom of the heap until both its children are
+ * due after it.
+ * @param idx heap slot of the thread
+ */
+void Scheduler::SiftDown(uint8_t idx)
+{
+		SchedulerThread* thread = heap[idx];
+
+		for(;;)
+		{
+				uint8_t child = (uint8_t)((idx * 2U) + 1U);
+				if(child >= threadCount)
+				{
+						break;
+				}
+				if(((child + 1U) < threadCount) && Earlier(heap[child + 1U], heap[child]))
+				{
+						child++;
+				}
+				if(!Earlier(heap[child], thread))
+				{
+						break;
+				}
+				Place(idx, heap[child]);
+				idx = child;
+		}
+		Place(idx, thread);
+}
+
+
+/**
+ * Reschedule
+ *
+ * Moves the thread in a heap slot to the right place after its deadline has
+ * changed, in whichever direction it changed.
+ * @param idx heap slot of the thread
+ */
+void Scheduler::Reschedule(uint8_t idx)
+{
+		SchedulerThread* thread = heap[idx];
+
+		SiftUp(idx);
+		SiftDown(thread->heapIdx);
+}
+
+
+/**
+ * add
+ *
+ * Adds a thread to the scheduler.
+ * @param  thread thread to add
+ * @return        true if the thread is in the scheduler, false if it is full
+ */
+bool Scheduler::add(SchedulerThread* thread)
+{
+		if(thread->scheduler != NULL)
+		{
+				/* already in a scheduler */
+				return (thread->scheduler == this);
+		}
+
+		if(threadCount >= SCHEDULER_MAX_THREADS)
+		{
+				return false;
+		}
+
+		thread->scheduler = this;
+		Attach(thread);
+		return true;
+}
+
+
+/**
+ * Attach
+ *
+ * Puts a thread that belongs to this scheduler into the heap.
+ * @param thread thread to put in
+ */
+void Scheduler::Attach(SchedulerThread* thread)
+{
+		Place(threadCount, thread);
+		threadCount++;
+		SiftUp((uint8_t)(threadCount - 1U));
+}
+
+
+/**
+ * remove
+ *
+ * Removes a thread from the scheduler, it is safe for a thread to remove
+ * itself from inside its callback.
+ * @param thread thread to remove
+ */
+void Scheduler::remove(SchedulerThread* thread)
+{
+		if(thread->scheduler != this)
+		{
+				return;
+		}
+
+		Detach(thread);
+		thread->scheduler = NULL;
+}
+
+
+/**
+ * wake
+ *
+ * Adds a thread that runs on demand. It runs straight away, unless it last
+ * ran less than one interval ago, in which case it runs one interval after
+ * that, so the interval limits how often it can run.
+ * @param  thread thread to add
+ * @return        true if the thread is in the scheduler, false if it is full
+ */
+bool Scheduler::wake(SchedulerThread* thread)
+{
+		unsigned long time = millis();
+
+		if(thread->scheduler == this)
+		{
+				/* already waiting to run */
+				return true;
+		}
+
+		/* Checked without signs, so a thread that last ran so long ago that millis()
+		   has wrapped still runs now */
+		if((time - thread->last_run) >= thread->interval)
+		{
+				thread->runned(time - thread->interval);
+		}
+		return add(thread);
+}
+
+
+/**
+ * Detach
+ *
+ * Takes a thread out of the heap, the thread still belongs to this scheduler.
+ * @param thread thread to take out
+ */
+void Scheduler::Detach(SchedulerThread* thread)
+{
+		uint8_t idx = thread->heapIdx;
+
+		if(idx == SCHEDULER_NOT_SCHEDULED)
+		{
+				return;
+		}
+
+		threadCount--;
+		thread->heapIdx = SCHEDULER_NOT_SCHEDULED;
+
+		/* Fill the gap with the last thread in the heap */
+		if(idx < threadCount)
+		{
+				Place(idx, heap[threadCount]);
+				Reschedule(idx);
+		}
+}
+
+
+/**
+ * run
+ *
+ * Runs the threads that are due, each one at most once per call as
+ * ThreadController does.
+ */
+void Scheduler::run(void)
+{
+		unsigned long time = millis();
+		SchedulerThread* stillDue[SCHEDULER_MAX_THREADS];
+		uint8_t stillDueCount = 0U;
+
+		/* The earliest deadline is always at the top of the heap, if that is not
+		   due then nothing else is */
+		while((threadCount > 0U) && Due(heap[0], time))
+		{
+				SchedulerThread* thread = heap[0];
+
+				if(thread->enabled)
+				{
+#ifdef SCHEDULER_STATS
+						RunTimed(thread, time);
+#else
+						thread->run();
+#endif
+				}
+				else
+				{
+						/* A disabled thread does not run, but is moved on by one interval so
+						   that it doesn't sit at the top of the heap */
+						thread->runned(time);
+				}
+
+				/* The callback may have removed its own thread */
+				if(thread->heapIdx != SCHEDULER_NOT_SCHEDULED)
+				{
+						if(Due(thread, time))
+						{
+								/* A thread with a zero interval is still due, take it out of the
+								   heap until the others have had their turn */
+								Detach(thread);
+								stillDue[stillDueCount] = thread;
+								stillDueCount++;
+						}
+						else
+						{
+								Reschedule(thread->heapIdx);
+						}
+				}
+		}
+
+		/* Put them back, unless a later callback removed them */
+		for(uint8_t idx = 0U; idx < stillDueCount; idx++)
+		{
+				if(stillDue[idx]->scheduler == this)
+				{
+						Attach(stillDue[idx]);
+				}
+		}
+
+#ifdef SCHEDULER_STATS
+		UpdateWindow();
+#endif
+}
+
+
+#ifdef SCHEDULER_STATS
+/**
+ * RunTimed
+ *
+ * Runs a thread, and records how long the callback took, and whether it
+ * started so late that a whole interval was missed.
+ * @param thread thread to run
+ * @param time   millis() when the scheduler started this pass
+ */
+void Scheduler::RunTimed(SchedulerThread* thread, unsigned long time)
+{
+		unsigned long late = time - thread->_cached_next_run;
+		unsigned long start;
+		unsigned long duration;
+
+		if((thread->interval > 0UL) && (late >= thread->interval) && (thread->overrunCount < 0xFFFFU))
+		{
+				thread->overrunCount++;
+		}
+
+		start = micros();
+		thread->run();
+		duration = micros() - start;
+
+		if(thread->callCount < 0xFFFFU)
+		{
+				thread->callCount++;
+				thread->totalTime += duration;
+		}
+		if(duration < thread->minTime)
+		{
+				thread->minTime = duration;
+		}
+		if(duration > thread->maxTime)
+		{
+				thread->maxTime = duration;
+		}
+		if(duration > worstTime)
+		{
+				worstTime = duration;
+		}
+		windowBusy += duration;
+}
+
+
+/**
+ * UpdateWindow
+ *
+ * Counts a pass of run(), and once per window works out the load and the
+ * loop rate.
+ */
+void Scheduler::UpdateWindow(void)
+{
+		unsigned long now = micros();
+		unsigned long elapsed = now - windowStart;
+
+		windowLoops++;
+		if(elapsed >= SCHEDULER_STATS_WINDOW_US)
+		{
+				unsigned long percent = windowBusy / (elapsed / 100UL);
+				loadPercent = (percent > 100UL) ? 100U : (uint8_t)percent;
+				loopsPerSecond = (uint16_t)(((unsigned long)windowLoops * 1000UL) / (elapsed / 1000UL));
+				windowStart = now;
+				windowBusy = 0UL;
+				windowLoops = 0U;
+		}
+}
+#endif
+
+
+/**
+ * load
+ *
+ * @return  the percentage of the last second spent in thread callbacks
+ */
+uint8_t Scheduler::load(void)
+{
+#ifdef SCHEDULER_STATS
+		return loadPercent;
+#else
+		return 0U;
+#endif
+}
+
+
+/**
+ * worstMicros
+ *
+ * @return  the longest any callback has taken in microseconds
+ */
+unsigned long Scheduler::worstMicros(void)
+{
+#ifdef SCHEDULER_STATS
+		return worstTime;
+#else
+		return 0UL;
+#endif
+}
+
+
+/**
+ * loopRate
+ *
+ * @return  the number of times run() was called in the last second
+ */
+uint16_t Scheduler::loopRate(void)
+{
+#ifdef SCHEDULER_STATS
+		return loopsPerSecond;
+#else
+		return 0U;
+#endif
+}
+
+
+/**
+ * report
+ *
+ * Prints the timings of every scheduled thread to the serial port, one line
+ * per thread: interval, calls, min, avg and max microseconds, and overruns.
+ */
+void Scheduler::report(void)
+{
+#ifdef SCHEDULER_STATS
+		Serial.println(F("ms\tcalls\tmin\tavg\tmax\tover"));
+		for(uint8_t idx = 0U; idx < threadCount; idx++)
+		{
+				SchedulerThread* thread = heap[idx];
+				Serial.print(thread->interval);
+				Serial.print('\t');
+				Serial.print(thread->calls());
+				Serial.print('\t');
+				Serial.print(thread->minMicros());
+				Serial.print('\t');
+				Serial.print(thread->avgMicros());
+				Serial.print('\t');
+				Serial.print(thread->maxMicros());
+				Serial.print('\t');
+				Serial.println(thread->overruns());
+		}
+#endif
+}
+
+
+/**
+ * due
+ *
+ * @return  true if any thread is due to run
+ */
+bool Scheduler::due(void)
+{
+		return (threadCount > 0U) && Due(heap[0], millis());
+}
+
+
+/**
+ * size
+ *
+ * @return  the number of threads in the scheduler
+ */
+int Scheduler::size(void)
+{
+		return (int)threadCount;
+}
@@ -0,0 +1,119 @@
+/*
+ * Scheduler.h
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Thread.h>
+
+/* Maximum number of threads that can be scheduled, the same as ThreadController */
+#define SCHEDULER_MAX_THREADS 15U
+
+/* heapIdx of a thread that is not in a scheduler */
+#define SCHEDULER_NOT_SCHEDULED 0xFFU
+
+/* Time each callback, count overruns and measure the load, comment out to
+   save 16 bytes of RAM per thread, the load will then read as 0 */
+#define SCHEDULER_STATS
+
+/* Time over which the load and loop rate are measured */
+#define SCHEDULER_STATS_WINDOW_US 1000000UL
+
+class Scheduler;
+
+/* A Thread that tells its scheduler when its deadline is moved by
+   setInterval, so that it can be put back in the right place */
+class SchedulerThread : public Thread
+{
+		friend class Scheduler;
+
+public:
+		SchedulerThread(void (*callback)(void) = NULL, unsigned long newInterval = 0);
+		virtual void setInterval(unsigned long newInterval);
+#ifdef SCHEDULER_STATS
+		uint16_t calls(void);
+		uint16_t overruns(void);
+		unsigned long minMicros(void);
+		unsigned long avgMicros(void);
+		unsigned long maxMicros(void);
+
+protected:
+		void resetStats(void);
+#endif
+
+private:
+		Scheduler* scheduler;
+		uint8_t heapIdx;
+#ifdef SCHEDULER_STATS
+		uint16_t callCount;       /* number of times the callback has run */
+		uint16_t overrunCount;    /* runs that started a whole interval late */
+		unsigned long minTime;    /* shortest callback in microseconds */
+		unsigned long maxTime;    /* longest callback in microseconds */
+		unsigned long totalTime;  /* all callbacks added up in microseconds */
+#endif
+};
+
+/* Runs threads in order of their next deadline. It has the same add, remove
+   and run calls as ThreadController, but keeps the threads in a min heap so
+   that run() only has to look at the earliest deadline when nothing is due */
+class Scheduler
+{
+		friend class SchedulerThread;
+
+public:
+		Scheduler(void);
+		bool add(SchedulerThread* thread);
+		void remove(SchedulerThread* thread);
+		bool wake(SchedulerThread* thread);
+		void run(void);
+		bool due(void);
+		int size(void);
+		uint8_t load(void);
+		unsigned long worstMicros(void);
+		uint16_t loopRate(void);
+		void report(void);
+
+private:
+		SchedulerThread* heap[SCHEDULER_MAX_THREADS];
+		uint8_t threadCount;
+#ifdef SCHEDULER_STATS
+		unsigned long windowStart;    /* micros() at the start of the window */
+		unsigned long windowBusy;     /* microseconds spent in callbacks this window */
+		uint16_t windowLoops;         /* calls to run() this window */
+		uint8_t loadPercent;          /* time spent in callbacks in the last window */
+		uint16_t loopsPerSecond;      /* calls to run() in the last window */
+		unsigned long worstTime;      /* longest callback of any thread */
+
+		void RunTimed(SchedulerThread* thread, unsigned long time);
+		void UpdateWindow(void);
+#endif
+
+		static bool Earlier(SchedulerThread* a, SchedulerThread* b);
+		static bool Due(SchedulerThread* thread, unsigned long time);
+		void Place(uint8_t idx, SchedulerThread* thread);
+		void SiftUp(uint8_t idx);
+		void SiftDown(uint8_t idx);
+		void Reschedule(uint8_t idx);
+		void Attach(SchedulerThread* thread);
+		void Detach(SchedulerThread* thread);
+};
+
+#endif /* SCHEDULER_H */
@@ -25,196 +25,874 @@
  *
  */
 /* Arduino libraries */
-#include <LedControl.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 
 /* Open DSKY headers */
 #include "Program.h"
 #include "SevenSegment.h"
+#include "Max7219.h"
+#include "Scheduler.h"
+#include "Latency.h"
 #include "main.h"
 
 /* VT100 code for clearing the screen */
 #define CLS  "\033[2J"
 //#define SERIAL_DEBUG
+//#define SEVEN_SEGMENT_BENCHMARK /* Time the display drivers and digit conversion at startup */
+//#define SERIAL_MIRROR /* Send the display to the serial port in binary, for tools/DSKYViewer */
+
+#if defined(SERIAL_MIRROR) && defined(SERIAL_DEBUG)
+#error "SERIAL_MIRROR and SERIAL_DEBUG both use the serial port"
+#endif
+
+/* The display is driven by Max7219, LedControl is only timed against it */
+#ifdef SEVEN_SEGMENT_BENCHMARK
+#include <LedControl.h>
+#endif
+
+/* The display is only drawn when something asks for it to be refreshed, and
+   no more than this many times a second */
+#define SEVEN_SEGMENT_MAX_FPS 25U
+
+/* The VERB and NOUN digits flash on and off every SEVEN_SEGMENT_FLASH_MS */
+#define SEVEN_SEGMENT_FLASH_MS 400U
+
+/* NumDigits of an echo field that isn't being drawn */
+#define SEVEN_SEGMENT_ECHO_OFF 0xFFU
+
+/* Digit registers of the tens digit of the fields on device 0, the units are
+   on the next row */
+#define SEVEN_SEGMENT_VERB_ROW 0U
+#define SEVEN_SEGMENT_PROG_ROW 2U
+#define SEVEN_SEGMENT_NOUN_ROW 4U
+
+SchedulerThread* sevenSegmentThread = new SchedulerThread();
+SchedulerThread* sevenSegmentFlashThread = new SchedulerThread();
+static bool sevenSegmentRefreshPending = false;
+static bool sevenSegmentFlashOff = false;
 
-Thread* sevenSegmentThread = new Thread();
+/* The entry echo layer holds whatever is being typed on the keyboard, it is
+   drawn over the foreground program's frame until the entry is finished. */
+typedef struct SEVEN_SEGMENT_ECHO_STRUCT
+{
+		int32_t Value;
+		uint8_t NumDigits;
+		char Sign;
+}SevenSegmentEchoStruct;
+
+static SevenSegmentEchoStruct sevenSegmentEcho[SEVEN_SEGMENT_NUM_FIELDS];
 
+#ifdef SEVEN_SEGMENT_BENCHMARK
 LedControl lc=LedControl(12,10,11,4);
+#endif
+
+#ifdef SERIAL_MIRROR
+/* A mirror frame is a byte with a bit set for each part of the display that
+   follows, the parts that have changed, then a checksum that makes all of the
+   bytes add up to 0. It is COBS encoded, so the only 0 is the one that ends
+   the frame, and a viewer can always find the start of the next frame. The
+   parts are PROG VERB NOUN, then R1, R2 and R3, 3 bytes each as they are in
+   SevenSegmentDisplayStruct. */
+#define SERIAL_MIRROR_NUM_PARTS  4U
+#define SERIAL_MIRROR_PART_BYTES 3U
+#define SERIAL_MIRROR_MAX_DATA   (1U + (SERIAL_MIRROR_NUM_PARTS * SERIAL_MIRROR_PART_BYTES) + 1U)
+#define SERIAL_MIRROR_MAX_FRAME  (SERIAL_MIRROR_MAX_DATA + 2U)
+
+/* Every this many mirror frames all of the parts are sent, so a viewer that
+   connects part way through catches up */
+#define SERIAL_MIRROR_KEY_FRAME  16U
+
+static_assert(offsetof(SevenSegmentDisplayStruct, R) == SERIAL_MIRROR_PART_BYTES, "Mirror expects PROG VERB NOUN in the first 3 bytes");
+static_assert(sizeof(((SevenSegmentDisplayStruct*)0)->R) == ((SERIAL_MIRROR_NUM_PARTS - 1U) * SERIAL_MIRROR_PART_BYTES), "Mirror expects 3 registers of 3 bytes");
+
+/* The display as it was last sent to the serial port */
+static SevenSegmentDisplayStruct sevenSegmentMirrored;
+static uint8_t sevenSegmentMirrorCount = 0U;
+#endif
+
+#define SEVEN_SEGMENT_NUM_DEVICES MAX7219_NUM_DEVICES
+#define SEVEN_SEGMENT_NUM_ROWS    8U
+
+/* Powers of ten for SevenSegmentToBCD */
+static const uint32_t powersOfTen[SEVEN_SEGMENT_BCD_DIGITS] PROGMEM =
+{
+		1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+		100000000UL, 1000000000UL
+};
+
+#ifdef SERIAL_DEBUG
+/* Character to print for each nibble of the display data */
+static const char nibbleChars[16] PROGMEM =
+{
+		'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '+', '-', ' ', ' ', ' ', ' '
+};
+#else
+/* Segments to light for each nibble of the display data, 0-9, plus, minus
+   and blanks */
+static const uint8_t nibbleSegments[16] PROGMEM =
+{
+		B01111110, B00110000, B01101101, B01111001, B00110011,
+		B01011011, B01011111, B01110000, B01111111, B01111011,
+		B01110100, B00100100, B00000000, B00000000, B00000000,
+		B00000000
+};
+
+/* The digit registers of each MAX7219, as they are being drawn, and as they
+   were last sent to the display. The display is drawn into sevenSegmentShadow
+   and only the rows that differ from sevenSegmentShown are sent. They are
+   stored row first, as a row is written to every device at once. */
+static uint8_t sevenSegmentShadow[SEVEN_SEGMENT_NUM_ROWS][SEVEN_SEGMENT_NUM_DEVICES];
+static uint8_t sevenSegmentShown[SEVEN_SEGMENT_NUM_ROWS][SEVEN_SEGMENT_NUM_DEVICES];
 
 
 /**
- * SevenSegmentThreadCallback
+ * ShadowSetRow
  *
- * The main callback function, this asks the Program module for the
- * latest display data from whatever is running in the foreground, then
- * it displays it.
+ * Same as LedControl::setRow, but draws into the shadow copy of the display.
+ * @param device MAX7219 on the chain
+ * @param row    digit register 0-7
+ * @param value  segments to light
  */
-void SevenSegmentThreadCallback()
+static void ShadowSetRow(uint8_t device, uint8_t row, uint8_t value)
 {
-		SevenSegmentDisplayStruct* displayData = ProgramGetDisplayData();
-		int32_t tempData = 0;
+		sevenSegmentShadow[row][device] = value;
+}
 
-		if(displayData != NULL)
+
+/**
+ * ShadowSetPacked
+ *
+ * Draws two digits of packed display data into the shadow copy.
+ * @param device MAX7219 on the chain
+ * @param row    digit register of the digit in the top nibble, the digit in
+ *               the bottom nibble is on the next row
+ * @param packed two nibbles of display data
+ */
+static void ShadowSetPacked(uint8_t device, uint8_t row, uint8_t packed)
+{
+		ShadowSetRow(device, row, pgm_read_byte(&nibbleSegments[packed >> 4]));
+		ShadowSetRow(device, row + 1U, pgm_read_byte(&nibbleSegments[packed & 0x0FU]));
+}
+
+
+/**
+ * ShadowFlush
+ *
+ * Sends the rows of the shadow copy that are different from what is on the
+ * display. A changed row is written to all of the devices in one frame, so in
+ * a steady display this sends nothing at all.
+ */
+static void ShadowFlush(void)
+{
+		for(uint8_t row = 0U; row < SEVEN_SEGMENT_NUM_ROWS; row++)
+		{
+				if(memcmp(sevenSegmentShadow[row], sevenSegmentShown[row], SEVEN_SEGMENT_NUM_DEVICES) != 0)
+				{
+						Max7219WriteRow(row, sevenSegmentShadow[row]);
+						memcpy(sevenSegmentShown[row], sevenSegmentShadow[row], SEVEN_SEGMENT_NUM_DEVICES);
+				}
+		}
+}
+#endif
+
+
+/**
+ * SevenSegmentRequestRefresh
+ *
+ * Asks for the display to be drawn again. The display thread is woken, and
+ * draws on the next pass of the scheduler, or once 1/SEVEN_SEGMENT_MAX_FPS
+ * seconds have passed since it last drew. Any number of requests before then
+ * give one redraw.
+ */
+void SevenSegmentRequestRefresh(void)
+{
+		sevenSegmentRefreshPending = true;
+		controll.wake(sevenSegmentThread);
+}
+
+
+/**
+ * SevenSegmentEcho
+ *
+ * Draws a number that is being typed over one of the fields of the foreground
+ * program's frame. Only the digits typed so far are shown, VERB and NOUN fill
+ * from the left, R1 to R3 from the right.
+ * @param field     field to draw the number in
+ * @param value     number typed so far
+ * @param numDigits number of digits that have been typed
+ * @param sign      '+' or '-' to show a sign in R1 to R3, ' ' for none
+ */
+void SevenSegmentEcho(SevenSegmentFieldEnum field, int32_t value, uint8_t numDigits, char sign)
+{
+		if(field < SEVEN_SEGMENT_NUM_FIELDS)
 		{
+				sevenSegmentEcho[field].Value = value;
+				sevenSegmentEcho[field].NumDigits = numDigits;
+				sevenSegmentEcho[field].Sign = sign;
+				SevenSegmentRequestRefresh();
+		}
+}
+
+
+/**
+ * SevenSegmentEchoClear
+ *
+ * Takes the keyboard entry off the display, so the foreground program's
+ * frame shows through again.
+ */
+void SevenSegmentEchoClear(void)
+{
+		for(uint8_t field = 0U; field < SEVEN_SEGMENT_NUM_FIELDS; field++)
+		{
+				sevenSegmentEcho[field].NumDigits = SEVEN_SEGMENT_ECHO_OFF;
+		}
+		SevenSegmentRequestRefresh();
+}
+
+
+/**
+ * SevenSegmentFlashCallback
+ *
+ * Turns the flashing VERB and NOUN digits on or off, and redraws them.
+ */
+static void SevenSegmentFlashCallback(void)
+{
+		sevenSegmentFlashOff = !sevenSegmentFlashOff;
+		SevenSegmentRequestRefresh();
+}
+
+
 #ifndef SERIAL_DEBUG
+/**
+ * SevenSegmentUpdateFlash
+ *
+ * Keeps the flash thread running only whilst the foreground program wants
+ * something flashed, so a steady display doesn't wake anything up.
+ * @param flash SEVEN_SEGMENT_FLASH_VERB and SEVEN_SEGMENT_FLASH_NOUN flags
+ */
+static void SevenSegmentUpdateFlash(uint8_t flash)
+{
+		if(flash != 0U)
+		{
+				(void)controll.add(sevenSegmentFlashThread);
+		}
+		else
+		{
+				controll.remove(sevenSegmentFlashThread);
+				sevenSegmentFlashOff = false;
+		}
+}
+#endif
+
+
+/**
+ * SevenSegmentBeginFrame
+ *
+ * Starts drawing a new frame, the back buffer is started off as a copy of
+ * the front buffer so only the things that change need to be drawn.
+ * @param  frame the program's display frame
+ * @return       the back buffer to draw into
+ */
+SevenSegmentDisplayStruct* SevenSegmentBeginFrame(SevenSegmentFrameStruct* frame)
+{
+		uint8_t frontIdx = frame->FrontIdx;
+		SevenSegmentDisplayStruct* back = &frame->Buffer[frontIdx ^ 1U];
+
+		*back = frame->Buffer[frontIdx];
+		return back;
+}
+
+
+/**
+ * SevenSegmentPublishFrame
+ *
+ * Makes the back buffer the front buffer, FrontIdx is a single byte so the
+ * swap can't be seen half done, then asks for the display to be redrawn.
+ * @param frame the program's display frame
+ */
+void SevenSegmentPublishFrame(SevenSegmentFrameStruct* frame)
+{
+		frame->FrontIdx = frame->FrontIdx ^ 1U;
+		SevenSegmentRequestRefresh();
+}
 
-				if((0x3 & displayData->R1DigitShowMask) != 0)
+
+/**
+ * SevenSegmentFrontBuffer
+ *
+ * @param  frame the program's display frame
+ * @return       the last published frame
+ */
+const SevenSegmentDisplayStruct* SevenSegmentFrontBuffer(const SevenSegmentFrameStruct* frame)
+{
+		return &frame->Buffer[frame->FrontIdx];
+}
+
+
+/**
+ * SevenSegmentToBCD
+ *
+ * Splits a number into its decimal digits without dividing, AVR has no
+ * divide instruction and a 32 bit division in software takes hundreds of
+ * cycles. Each digit is found by taking away its power of ten until it
+ * won't go, which is at most 9 subtractions per digit.
+ * @param value  number to convert
+ * @param digits filled with SEVEN_SEGMENT_BCD_DIGITS digits, least significant
+ *               first
+ */
+void SevenSegmentToBCD(uint32_t value, uint8_t digits[SEVEN_SEGMENT_BCD_DIGITS])
+{
+		for(uint8_t idx = SEVEN_SEGMENT_BCD_DIGITS - 1U; idx > 0U; idx--)
+		{
+				uint32_t power = pgm_read_dword(&powersOfTen[idx]);
+				uint8_t digit = 0U;
+
+				while(value >= power)
 				{
-						lc.setDigit(0, 3, (displayData->Prog%10)&0xF, false);
-						lc.setDigit(0, 2, (displayData->Prog/10)&0xF, false);
+						value -= power;
+						digit++;
 				}
-				if((0xC & displayData->R1DigitShowMask) != 0)
+				digits[idx] = digit;
+		}
+		digits[0] = (uint8_t)value;
+}
+
+
+/**
+ * SevenSegmentPack
+ *
+ * Packs a sign and up to 5 BCD digits into R1, R2 or R3. Bits 0 to 4 of the
+ * mask show the digits from the right, the digits fill the shown places from
+ * the right starting at digits[first], and the rest are blank.
+ * @param packed register to pack into
+ * @param digits BCD digits, least significant first
+ * @param first  index of the first digit to show
+ * @param sign   SEVEN_SEGMENT_PLUS, SEVEN_SEGMENT_MINUS or SEVEN_SEGMENT_BLANK
+ * @param mask   digit show mask
+ */
+static void SevenSegmentPack(uint8_t packed[SEVEN_SEGMENT_REGISTER_BYTES], const uint8_t digits[SEVEN_SEGMENT_BCD_DIGITS],
+                             uint8_t first, uint8_t sign, uint8_t mask)
+{
+		uint8_t nibbles[SEVEN_SEGMENT_REGISTER_DIGITS + 1U];
+
+		nibbles[0] = sign;
+		for(uint8_t i = 0U; i < SEVEN_SEGMENT_REGISTER_DIGITS; i++)
+		{
+				if((((1U << i) & mask) != 0U) && (first < SEVEN_SEGMENT_BCD_DIGITS))
 				{
-						lc.setDigit(0, 5, (displayData->Noun%10)&0xF, false);
-						lc.setDigit(0, 4, (displayData->Noun/10)&0xF, false);
+						nibbles[SEVEN_SEGMENT_REGISTER_DIGITS - i] = digits[first];
+						first++;
 				}
-				if((0x30 & displayData->R1DigitShowMask) != 0)
+				else
 				{
-						lc.setDigit(0, 1, (displayData->Verb%10)&0xF, false);
-						lc.setDigit(0, 0, (displayData->Verb/10)&0xF, false);
+						nibbles[SEVEN_SEGMENT_REGISTER_DIGITS - i] = SEVEN_SEGMENT_BLANK;
 				}
+		}
 
-				tempData = displayData->R1;
-				if((0x20 & displayData->R1DigitShowMask) == 0x20)
+		for(uint8_t idx = 0U; idx < SEVEN_SEGMENT_REGISTER_BYTES; idx++)
+		{
+				packed[idx] = (uint8_t)((nibbles[idx * 2U] << 4) | nibbles[(idx * 2U) + 1U]);
+		}
+}
+
+
+/**
+ * SevenSegmentSetDigits
+ *
+ * Puts a number into R1, R2 or R3 of a frame. Bits 0 to 4 of the mask show
+ * the digits from the right, the number's digits fill the shown places from
+ * the right, SEVEN_SEGMENT_SHOW_SIGN shows the sign and
+ * SEVEN_SEGMENT_HIDE_PLUS leaves it blank for positive numbers.
+ * @param displayData frame to draw into
+ * @param reg         SEVEN_SEGMENT_R1, SEVEN_SEGMENT_R2 or SEVEN_SEGMENT_R3
+ * @param value       number to show
+ * @param mask        digit show mask
+ */
+void SevenSegmentSetDigits(SevenSegmentDisplayStruct* displayData, SevenSegmentFieldEnum reg, int32_t value, uint8_t mask)
+{
+		uint8_t digits[SEVEN_SEGMENT_BCD_DIGITS];
+		uint8_t sign = SEVEN_SEGMENT_BLANK;
+
+		if((reg < SEVEN_SEGMENT_R1) || (reg > SEVEN_SEGMENT_R3))
+		{
+				return;
+		}
+
+		if((SEVEN_SEGMENT_SHOW_SIGN & mask) != 0U)
+		{
+				if(value < 0)
 				{
-						if(tempData < 0 )
-						{
-								lc.setRow(1,0,B00100100);
-								tempData *= -1;
-						}
-						else
-						{
-								lc.setRow(1,0,B01110100);
-						}
+						sign = SEVEN_SEGMENT_MINUS;
 				}
-				for (int i = 0; i < 5; i++)
+				else if((SEVEN_SEGMENT_HIDE_PLUS & mask) == 0U)
 				{
-						if(((1 << i)  & displayData->R1DigitShowMask) != 0)
-						{
-								lc.setDigit(1, (5-i), (tempData % 10), false);
-								tempData/=10;
-						}
-						else
-						{
-								lc.setChar(1, (5-i), ' ', false);
-						}
+						sign = SEVEN_SEGMENT_PLUS;
 				}
-				tempData = displayData->R2;
-				if((0x20 & displayData->R2DigitShowMask) == 0x20)
+		}
+
+		SevenSegmentToBCD((value < 0) ? (0UL - (uint32_t)value) : (uint32_t)value, digits);
+		SevenSegmentPack(displayData->R[reg - SEVEN_SEGMENT_R1], digits, 0U, sign, mask);
+}
+
+
+/**
+ * SevenSegmentSetRegister
+ *
+ * Puts a fixed point number into R1, R2 or R3 of a frame. The number is
+ * value * 10^-decimals, there is no decimal point on the display so a blank
+ * digit is used instead. As many decimal places are shown as will fit next
+ * to the whole number part, the rest are cut off, and the whole number part
+ * is padded with zeros to fill the register. Numbers too big for the
+ * register are shown as 99999. It is all done on the BCD digits, so there
+ * is no floating point or division.
+ * @param displayData frame to draw into
+ * @param reg         SEVEN_SEGMENT_R1, SEVEN_SEGMENT_R2 or SEVEN_SEGMENT_R3
+ * @param value       number to show, scaled up by 10^decimals
+ * @param decimals    number of decimal places in value
+ * @param sign        how to show the sign
+ */
+void SevenSegmentSetRegister(SevenSegmentDisplayStruct* displayData, SevenSegmentFieldEnum reg, int32_t value, uint8_t decimals, SevenSegmentSignEnum sign)
+{
+		uint8_t digits[SEVEN_SEGMENT_BCD_DIGITS];
+		uint8_t wholeDigits = 1U;
+		uint8_t fracDigits = 0U;
+		uint8_t mask = 0x1FU;
+		uint8_t signNibble = SEVEN_SEGMENT_BLANK;
+
+		if((reg < SEVEN_SEGMENT_R1) || (reg > SEVEN_SEGMENT_R3))
+		{
+				return;
+		}
+
+		if(decimals >= SEVEN_SEGMENT_BCD_DIGITS)
+		{
+				decimals = SEVEN_SEGMENT_BCD_DIGITS - 1U;
+		}
+
+		SevenSegmentToBCD((value < 0) ? (0UL - (uint32_t)value) : (uint32_t)value, digits);
+
+		/* count the digits in front of the decimal place */
+		for(uint8_t idx = SEVEN_SEGMENT_BCD_DIGITS - 1U; idx > decimals; idx--)
+		{
+				if(digits[idx] != 0U)
 				{
-						if(tempData < 0 )
-						{
-								lc.setRow(2,0,B00100100);
-								tempData *= -1;
-						}
-						else
-						{
-								lc.setRow(2,0,B01110100);
-						}
+						wholeDigits = idx - decimals + 1U;
+						break;
 				}
+		}
+
+		if(wholeDigits > SEVEN_SEGMENT_REGISTER_DIGITS)
+		{
+				memset(digits, 9U, sizeof(digits));
+				decimals = 0U;
+		}
+		else if((decimals > 0U) && (wholeDigits < (SEVEN_SEGMENT_REGISTER_DIGITS - 1U)))
+		{
+				/* fit in as many decimal places as there is room for after the blank */
+				fracDigits = min(decimals, (uint8_t)(SEVEN_SEGMENT_REGISTER_DIGITS - 1U - wholeDigits));
+				mask &= (uint8_t)~(1U << fracDigits);
+		}
+
+		if((sign == SEVEN_SEGMENT_SIGN_AUTO) || ((sign == SEVEN_SEGMENT_SIGN_MINUS_ONLY) && (value < 0)))
+		{
+				signNibble = (value < 0) ? SEVEN_SEGMENT_MINUS : SEVEN_SEGMENT_PLUS;
+		}
+
+		SevenSegmentPack(displayData->R[reg - SEVEN_SEGMENT_R1], digits, decimals - fracDigits, signNibble, mask);
+}
+
+
+/**
+ * SevenSegmentEchoPair
+ *
+ * Packs a VERB or NOUN that is being typed, the digits typed so far are
+ * shown from the left. The digits come from SevenSegmentToBCD, so there is
+ * no 32 bit division on the way from a key to the display.
+ * @param  echo the number being typed
+ * @return      packed VERB or NOUN
+ */
+static uint8_t SevenSegmentEchoPair(const SevenSegmentEchoStruct* echo)
+{
+		uint8_t digits[SEVEN_SEGMENT_BCD_DIGITS];
+
+		if(echo->NumDigits == 0U)
+		{
+				return SEVEN_SEGMENT_BLANK_PAIR;
+		}
+
+		/* only the last two digits typed are shown */
+		SevenSegmentToBCD((echo->Value < 0) ? (uint32_t)(-echo->Value) : (uint32_t)echo->Value, digits);
+		if(echo->NumDigits >= 2U)
+		{
+				return (uint8_t)((digits[1] << 4) | digits[0]);
+		}
+		return (uint8_t)((digits[0] << 4) | SEVEN_SEGMENT_BLANK);
+}
+
+
+/**
+ * SevenSegmentCompose
+ *
+ * Builds the frame to show one layer at a time. The foreground program's
+ * frame goes at the bottom, then the flashing VERB and NOUN are blanked when
+ * they are in their off phase, and whatever is being typed on the keyboard
+ * goes on top.
+ * @param displayData foreground program's frame, NULL if there isn't one
+ * @param composite   filled with the frame to show
+ */
+static void SevenSegmentCompose(const SevenSegmentDisplayStruct* displayData, SevenSegmentDisplayStruct* composite)
+{
+		const SevenSegmentEchoStruct* echo;
+
+		if(displayData != NULL)
+		{
+				*composite = *displayData;
+		}
+		else
+		{
+				/* nothing in the foreground */
+				memset(composite, 0xFF, sizeof(SevenSegmentDisplayStruct));
+				composite->Flags = 0U;
+		}
 
-				for (int i = 0; i < 5; i++)
+		if(sevenSegmentFlashOff)
+		{
+				if((composite->Flags & SEVEN_SEGMENT_FLASH_VERB) != 0U)
 				{
-						if(((1 << i)  & displayData->R2DigitShowMask) != 0)
-						{
-								lc.setDigit(2, (5-i), (tempData % 10), false);
-								tempData/=10;
-						}
-						else
-						{
-								lc.setChar(2, (5-i), ' ', false);
-						}
+						composite->Verb = SEVEN_SEGMENT_BLANK_PAIR;
 				}
-				tempData = displayData->R3;
-				if((0x20 & displayData->R3DigitShowMask) == 0x20)
+				if((composite->Flags & SEVEN_SEGMENT_FLASH_NOUN) != 0U)
 				{
-						if(tempData < 0 )
-						{
-								lc.setRow(3,0,B00100100);
-								tempData *= -1;
-						}
-						else
-						{
-								lc.setRow(3,0,B01110100);
-						}
+						composite->Noun = SEVEN_SEGMENT_BLANK_PAIR;
 				}
+		}
 
-				for (int i = 0; i < 5; i++)
+		echo = &sevenSegmentEcho[SEVEN_SEGMENT_VERB];
+		if(echo->NumDigits != SEVEN_SEGMENT_ECHO_OFF)
+		{
+				composite->Verb = SevenSegmentEchoPair(echo);
+		}
+		echo = &sevenSegmentEcho[SEVEN_SEGMENT_NOUN];
+		if(echo->NumDigits != SEVEN_SEGMENT_ECHO_OFF)
+		{
+				composite->Noun = SevenSegmentEchoPair(echo);
+		}
+		for(uint8_t reg = SEVEN_SEGMENT_R1; reg <= SEVEN_SEGMENT_R3; reg++)
+		{
+				echo = &sevenSegmentEcho[reg];
+				if(echo->NumDigits != SEVEN_SEGMENT_ECHO_OFF)
 				{
-						if(((1 << i)  & displayData->R3DigitShowMask) != 0)
+						uint8_t* packed = composite->R[reg - SEVEN_SEGMENT_R1];
+						uint8_t sign = SEVEN_SEGMENT_BLANK;
+
+						/* the typed digits are shown from the right */
+						SevenSegmentSetDigits(composite, (SevenSegmentFieldEnum)reg, echo->Value,
+						                      (uint8_t)((1U << min(echo->NumDigits, SEVEN_SEGMENT_REGISTER_DIGITS)) - 1U));
+						if(echo->Sign == '+')
 						{
-								lc.setDigit(3, (5-i), (tempData % 10), false);
-								tempData/=10;
+								sign = SEVEN_SEGMENT_PLUS;
 						}
-						else
+						else if(echo->Sign == '-')
 						{
-								lc.setChar(3, (5-i), ' ', false);
+								sign = SEVEN_SEGMENT_MINUS;
 						}
+						packed[0] = (uint8_t)((sign << 4) | (packed[0] & 0x0FU));
 				}
+		}
+}
 
 
+#ifndef SERIAL_DEBUG
+/**
+ * ShadowDraw
+ *
+ * Draws a frame into the shadow copy, each nibble is one digit.
+ * @param composite frame to draw
+ */
+static void ShadowDraw(const SevenSegmentDisplayStruct* composite)
+{
+		ShadowSetPacked(0U, SEVEN_SEGMENT_VERB_ROW, composite->Verb);
+		ShadowSetPacked(0U, SEVEN_SEGMENT_PROG_ROW, composite->Prog);
+		ShadowSetPacked(0U, SEVEN_SEGMENT_NOUN_ROW, composite->Noun);
+
+		for(uint8_t reg = 0U; reg < SEVEN_SEGMENT_NUM_REGISTERS; reg++)
+		{
+				for(uint8_t idx = 0U; idx < SEVEN_SEGMENT_REGISTER_BYTES; idx++)
+				{
+						ShadowSetPacked(reg + 1U, idx * 2U, composite->R[reg][idx]);
+				}
+		}
+}
 #else
-#ifdef VT100
-				Serial.print(CLS);
+
+
+/**
+ * SerialPrintPacked
+ *
+ * Prints packed display data to the serial port, one character per nibble.
+ * @param packed   display data to print
+ * @param numBytes number of bytes to print
+ */
+static void SerialPrintPacked(const uint8_t* packed, uint8_t numBytes)
+{
+		for(uint8_t idx = 0U; idx < numBytes; idx++)
+		{
+				Serial.print((char)pgm_read_byte(&nibbleChars[packed[idx] >> 4]));
+				Serial.print((char)pgm_read_byte(&nibbleChars[packed[idx] & 0x0FU]));
+		}
+}
 #endif
-				Serial.print("    P");
-				if(displayData->Prog != 0)
+
+
+#ifdef SERIAL_MIRROR
+/**
+ * SerialMirrorEncode
+ *
+ * COBS encodes a mirror frame, every 0 is replaced with the distance to the
+ * next one, and a 0 is put on the end. Frames are always shorter than 254
+ * bytes, so there is only ever one byte of overhead.
+ * @param  data    bytes to encode
+ * @param  length  number of bytes to encode
+ * @param  encoded filled with the encoded frame, length + 2 bytes long
+ * @return         length of the encoded frame
+ */
+static uint8_t SerialMirrorEncode(const uint8_t* data, uint8_t length, uint8_t* encoded)
+{
+		uint8_t codeIdx = 0U;
+		uint8_t code = 1U;
+		uint8_t out = 1U;
+
+		for(uint8_t idx = 0U; idx < length; idx++)
+		{
+				if(data[idx] == 0U)
 				{
-						Serial.println(displayData->Prog);
+						encoded[codeIdx] = code;
+						codeIdx = out;
+						out++;
+						code = 1U;
 				}
 				else
 				{
-						Serial.println("  ");
+						encoded[out] = data[idx];
+						out++;
+						code++;
 				}
-				Serial.print("V");
-				Serial.print(displayData->Verb);
-				Serial.print(" N");
-				Serial.println(displayData->Noun);
+		}
+		encoded[codeIdx] = code;
+		encoded[out] = 0U;
+		return out + 1U;
+}
 
 
-				if(displayData->R1 > 0 )
-				{
-						Serial.print("+");
-				}
-				else
+/**
+ * SerialMirror
+ *
+ * Sends the parts of the display that have changed since they were last sent
+ * to the serial port. It never waits for the serial port, if there isn't
+ * room in the transmit buffer another refresh is requested, so the changes
+ * are sent with the next frame even if nothing else changes.
+ * @param composite the frame that is on the display
+ */
+static void SerialMirror(const SevenSegmentDisplayStruct* composite)
+{
+		const uint8_t* shown = &composite->Verb;
+		uint8_t* mirrored = &sevenSegmentMirrored.Verb;
+		uint8_t data[SERIAL_MIRROR_MAX_DATA];
+		uint8_t frame[SERIAL_MIRROR_MAX_FRAME];
+		uint8_t length = 1U;
+		uint8_t parts = 0U;
+		uint8_t sum = 0U;
+
+		for(uint8_t part = 0U; part < SERIAL_MIRROR_NUM_PARTS; part++)
+		{
+				const uint8_t* bytes = &shown[part * SERIAL_MIRROR_PART_BYTES];
+
+				if((sevenSegmentMirrorCount == 0U) ||
+				   (memcmp(bytes, &mirrored[part * SERIAL_MIRROR_PART_BYTES], SERIAL_MIRROR_PART_BYTES) != 0))
 				{
-						displayData->R1*=-1;
-						Serial.print("-");
+						parts |= (uint8_t)(1U << part);
+						memcpy(&data[length], bytes, SERIAL_MIRROR_PART_BYTES);
+						length += SERIAL_MIRROR_PART_BYTES;
 				}
+		}
 
-				Serial.println(displayData->R1);
+		if(parts == 0U)
+		{
+				return;
+		}
+
+		data[0] = parts;
+		for(uint8_t idx = 0U; idx < length; idx++)
+		{
+				sum += data[idx];
+		}
+		data[length] = (uint8_t)(0U - sum);
+		length = SerialMirrorEncode(data, length + 1U, frame);
 
+		if(Serial.availableForWrite() < length)
+		{
+				SevenSegmentRequestRefresh();
+				return;
+		}
+		Serial.write(frame, length);
+
+		memcpy(mirrored, shown, SERIAL_MIRROR_NUM_PARTS * SERIAL_MIRROR_PART_BYTES);
+		sevenSegmentMirrorCount++;
+		if(sevenSegmentMirrorCount >= SERIAL_MIRROR_KEY_FRAME)
+		{
+				sevenSegmentMirrorCount = 0U;
+		}
+}
+#endif
+
+
+/**
+ * SevenSegmentThreadCallback
+ *
+ * The main callback function, this asks the Program module for the
+ * latest display data from whatever is running in the foreground, puts the
+ * keyboard entry over it, then it displays it. It only runs when a refresh
+ * has been requested, and takes itself out of the scheduler once the display
+ * is drawn.
+ */
+void SevenSegmentThreadCallback()
+{
+		const SevenSegmentDisplayStruct* displayData = ProgramGetDisplayData();
+		SevenSegmentDisplayStruct composite;
+
+		sevenSegmentRefreshPending = false;
+		controll.remove(sevenSegmentThread);
+
+#ifndef SERIAL_DEBUG
+		SevenSegmentUpdateFlash((displayData != NULL) ?
+		                        (displayData->Flags & (SEVEN_SEGMENT_FLASH_VERB | SEVEN_SEGMENT_FLASH_NOUN)) : 0U);
+		SevenSegmentCompose(displayData, &composite);
+		LatencyMark(LATENCY_COMPOSED);
+		ShadowDraw(&composite);
+
+		/* Only send the rows that have changed */
+		ShadowFlush();
+		LatencyMark(LATENCY_WRITTEN);
+#ifdef SERIAL_MIRROR
+		SerialMirror(&composite);
+#endif
 
-				if(displayData->R2 > 0 )
+#else
+		SevenSegmentCompose(displayData, &composite);
+		LatencyMark(LATENCY_COMPOSED);
+#ifdef VT100
+		Serial.print(CLS);
+#endif
+		Serial.print("    P");
+		SerialPrintPacked(&composite.Prog, 1U);
+		Serial.println();
+		Serial.print("V");
+		SerialPrintPacked(&composite.Verb, 1U);
+		Serial.print(" N");
+		SerialPrintPacked(&composite.Noun, 1U);
+		Serial.println();
+
+		for(uint8_t reg = 0U; reg < SEVEN_SEGMENT_NUM_REGISTERS; reg++)
+		{
+				SerialPrintPacked(composite.R[reg], SEVEN_SEGMENT_REGISTER_BYTES);
+				Serial.println();
+		}
+		Serial.println(" ");
+		LatencyMark(LATENCY_WRITTEN);
+#endif
+}
+
+
+#ifdef SEVEN_SEGMENT_BENCHMARK
+/**
+ * SevenSegmentBenchmarkBCD
+ *
+ * Times getting the 5 digits of a register by dividing by 10, as the display
+ * used to, and with SevenSegmentToBCD, and prints the average cycles each.
+ */
+static void SevenSegmentBenchmarkBCD(void)
+{
+		static const int32_t testValues[4] = {7L, 1234L, 99999L, 1234567L};
+		volatile uint8_t sink;
+		uint8_t digits[SEVEN_SEGMENT_BCD_DIGITS];
+		unsigned long start;
+		unsigned long divideTime;
+		unsigned long bcdTime;
+
+		start = micros();
+		for(uint8_t run = 0U; run < 64U; run++)
+		{
+				for(uint8_t idx = 0U; idx < 4U; idx++)
 				{
-						Serial.print("+");
+						volatile int32_t tempData = testValues[idx];
+						for(uint8_t i = 0U; i < SEVEN_SEGMENT_REGISTER_DIGITS; i++)
+						{
+								sink = (uint8_t)(tempData % 10);
+								tempData /= 10;
+						}
 				}
-				else
+		}
+		divideTime = micros() - start;
+
+		start = micros();
+		for(uint8_t run = 0U; run < 64U; run++)
+		{
+				for(uint8_t idx = 0U; idx < 4U; idx++)
 				{
-						displayData->R2*=-1;
-						Serial.print("-");
+						SevenSegmentToBCD((uint32_t)testValues[idx], digits);
+						sink = digits[0];
 				}
+		}
+		bcdTime = micros() - start;
+		(void)sink;
 
+		Serial.print(F("Divide register cycles: "));
+		Serial.println((divideTime * clockCyclesPerMicrosecond()) / 256UL);
+		Serial.print(F("BCD register cycles: "));
+		Serial.println((bcdTime * clockCyclesPerMicrosecond()) / 256UL);
+}
 
-				Serial.println(displayData->R2);
 
+/**
+ * SevenSegmentBenchmark
+ *
+ * Times writing every digit of every display, first through LedControl one
+ * device at a time, then through Max7219 one row at a time, and prints both
+ * to the serial port.
+ */
+static void SevenSegmentBenchmark(void)
+{
+		static const uint8_t rowValues[SEVEN_SEGMENT_NUM_DEVICES] = {0x7EU, 0x7EU, 0x7EU, 0x7EU};
+		unsigned long start;
+		unsigned long ledControlTime;
+		unsigned long max7219Time;
 
-				if(displayData->R3 > 0 )
-				{
-						Serial.print("+");
-				}
-				else
+		start = micros();
+		for(uint8_t device = 0U; device < SEVEN_SEGMENT_NUM_DEVICES; device++)
+		{
+				for(uint8_t row = 0U; row < SEVEN_SEGMENT_NUM_ROWS; row++)
 				{
-						displayData->R3*=-1;
-						Serial.print("-");
+						lc.setRow(device, row, rowValues[device]);
 				}
-				Serial.println(displayData->R3);
-				Serial.println(" ");
-#endif
 		}
+		ledControlTime = micros() - start;
+
+		start = micros();
+		for(uint8_t row = 0U; row < SEVEN_SEGMENT_NUM_ROWS; row++)
+		{
+				Max7219WriteRow(row, rowValues);
+		}
+		max7219Time = micros() - start;
+
+		Serial.print(F("LedControl frame us: "));
+		Serial.println(ledControlTime);
+		Serial.print(F("Max7219 frame us: "));
+		Serial.println(max7219Time);
+
+		SevenSegmentBenchmarkBCD();
 }
+#endif
 
 
 /**
@@ -225,17 +903,18 @@ void SevenSegmentThreadCallback()
 void SevenSegmentSetup(void)
 {
 		/* intialise the 7 segment drivers */
-		for(uint8_t idx = 0U; idx < 4U; idx++)
-		{
-				lc.shutdown(idx,false);
-				lc.setIntensity(idx,8);
-				lc.clearDisplay(idx);
-		}
+		Max7219Setup(8U);
 
+#ifdef SEVEN_SEGMENT_BENCHMARK
+		SevenSegmentBenchmark();
+		Max7219Setup(8U);
+#endif
 
 		sevenSegmentThread->onRun(SevenSegmentThreadCallback);
-		sevenSegmentThread->setInterval(250);
-		controll.add(sevenSegmentThread);
+		sevenSegmentThread->setInterval(1000U / SEVEN_SEGMENT_MAX_FPS);
+		sevenSegmentFlashThread->onRun(SevenSegmentFlashCallback);
+		sevenSegmentFlashThread->setInterval(SEVEN_SEGMENT_FLASH_MS);
+		SevenSegmentEchoClear();
 
 
 }
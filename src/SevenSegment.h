@@ -21,19 +21,86 @@
  */
 #ifndef SEVEN_SEGMENT_H
 #define SEVEN_SEGMENT_H
+
+/* Number of digits in R1, R2 and R3 */
+#define SEVEN_SEGMENT_REGISTER_DIGITS 5U
+
+/* Number of decimal digits in a uint32_t */
+#define SEVEN_SEGMENT_BCD_DIGITS 10U
+
+/* Flags in SevenSegmentDisplayStruct, the driver flashes the VERB and NOUN
+   digits by itself while they are set, like the AGC asking for input */
+#define SEVEN_SEGMENT_FLASH_VERB 0x01U
+#define SEVEN_SEGMENT_FLASH_NOUN 0x02U
+
+/* Show mask bits for SevenSegmentSetDigits, bits 0 to 4 show the digits
+   from the right, then show the sign, and show a blank instead of a plus */
+#define SEVEN_SEGMENT_SHOW_SIGN  0x20U
+#define SEVEN_SEGMENT_HIDE_PLUS  0x40U
+
+/* R1, R2 and R3 are each a sign followed by 5 digits, packed into 3 bytes */
+#define SEVEN_SEGMENT_NUM_REGISTERS  3U
+#define SEVEN_SEGMENT_REGISTER_BYTES 3U
+
+/* Nibbles of the packed display data, 0 to 9 are digits */
+#define SEVEN_SEGMENT_PLUS  0xAU
+#define SEVEN_SEGMENT_MINUS 0xBU
+#define SEVEN_SEGMENT_BLANK 0xFU
+
+/* PROG, VERB and NOUN as two packed BCD digits, tens in the top nibble */
+#define SEVEN_SEGMENT_PAIR(value) ((uint8_t)((((value) / 10U) << 4) | ((value) % 10U)))
+#define SEVEN_SEGMENT_BLANK_PAIR  0xFFU
+
+/* The display data is kept as one nibble per digit, in the order the digits
+   are on the display, so the driver can look up the segments of each digit
+   without any conversion. Use SEVEN_SEGMENT_PAIR for PROG, VERB and NOUN and
+   SevenSegmentSetDigits or SevenSegmentSetRegister for R1 to R3. */
 typedef struct SEVEN_SEGMENT_DISPLAY_STRUCT
 {
-		int32_t R1;
-		int32_t R2;
-		int32_t R3;
 		uint8_t Verb;
-		uint8_t Noun;
 		uint8_t Prog;
-		uint8_t R1DigitShowMask;
-		uint8_t R2DigitShowMask;
-		uint8_t R3DigitShowMask;
+		uint8_t Noun;
+		uint8_t R[SEVEN_SEGMENT_NUM_REGISTERS][SEVEN_SEGMENT_REGISTER_BYTES];
+		uint8_t Flags;
 }SevenSegmentDisplayStruct;
 
+/* The fields that keyboard entry can be echoed into */
+typedef enum SEVEN_SEGMENT_FIELD_ENUM
+{
+		SEVEN_SEGMENT_VERB,
+		SEVEN_SEGMENT_NOUN,
+		SEVEN_SEGMENT_R1,
+		SEVEN_SEGMENT_R2,
+		SEVEN_SEGMENT_R3,
+		SEVEN_SEGMENT_NUM_FIELDS
+}SevenSegmentFieldEnum;
+
+/* How SevenSegmentSetRegister shows the sign of a number */
+typedef enum SEVEN_SEGMENT_SIGN_ENUM
+{
+		SEVEN_SEGMENT_SIGN_NONE,       /* no sign, just the magnitude */
+		SEVEN_SEGMENT_SIGN_AUTO,       /* + or - */
+		SEVEN_SEGMENT_SIGN_MINUS_ONLY  /* - when negative, blank otherwise */
+}SevenSegmentSignEnum;
+
+/* Double buffered display data. Programs draw into the back buffer, and
+   publish it by swapping the buffers, the display driver only ever reads the
+   front buffer, so it never sees a half drawn frame. */
+typedef struct SEVEN_SEGMENT_FRAME_STRUCT
+{
+		SevenSegmentDisplayStruct Buffer[2];
+		volatile uint8_t FrontIdx;
+}SevenSegmentFrameStruct;
+
 
 extern void SevenSegmentSetup(void);
+extern void SevenSegmentRequestRefresh(void);
+extern void SevenSegmentEcho(SevenSegmentFieldEnum field, int32_t value, uint8_t numDigits, char sign);
+extern void SevenSegmentEchoClear(void);
+extern SevenSegmentDisplayStruct* SevenSegmentBeginFrame(SevenSegmentFrameStruct* frame);
+extern void SevenSegmentPublishFrame(SevenSegmentFrameStruct* frame);
+extern const SevenSegmentDisplayStruct* SevenSegmentFrontBuffer(const SevenSegmentFrameStruct* frame);
+extern void SevenSegmentSetDigits(SevenSegmentDisplayStruct* displayData, SevenSegmentFieldEnum reg, int32_t value, uint8_t mask);
+extern void SevenSegmentSetRegister(SevenSegmentDisplayStruct* displayData, SevenSegmentFieldEnum reg, int32_t value, uint8_t decimals, SevenSegmentSignEnum sign);
+extern void SevenSegmentToBCD(uint32_t value, uint8_t digits[SEVEN_SEGMENT_BCD_DIGITS]);
 #endif /*SEVEN_SEGMENT_H */
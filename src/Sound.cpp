@@ -33,9 +33,9 @@
 #include <Wire.h>
 #include <Thread.h>
 #include <SoftwareSerial.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 #include "Sound.h"
+#include "Scheduler.h"
 #include "main.h"
 
 
@@ -70,7 +70,7 @@ static uint8_t packet[NUM_SOUND_BYTES] = {0x7EU, 0xFFU, 0U, 0U, 0U, 0U, 0U, 0U,
 #include <digitalWriteFast.h>
 static TracksEnum currentTrack = NUM_TRACKS;
 static TracksEnum requestedTrack = NUM_TRACKS;
-Thread* SoundThread = new Thread();
+SchedulerThread* SoundThread = new SchedulerThread();
 
 #endif
 
@@ -0,0 +1,143 @@
+/*
+ * ThreadPool.cpp
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * A fixed size pool of statically allocated threads for programs to use.
+ * Programs start and stop all the time, so rather than creating and deleting
+ * threads on the heap (which soon fragments on a 2KB part) they take a thread
+ * from this pool when they start, and give it back when they stop.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <Thread.h>
+
+/* Open DSKY headers */
+#include "ThreadPool.h"
+#include "Scheduler.h"
+#include "main.h"
+
+
+/* Thread with access to its own timing, so that it can be restarted as if it
+   had just been created */
+class PoolThread : public SchedulerThread
+{
+public:
+		void Start(void (*callback)(void), unsigned long newInterval)
+		{
+				enabled = true;
+				onRun(callback);
+				runned();
+				setInterval(newInterval);
+#ifdef SCHEDULER_STATS
+				resetStats();
+#endif
+		}
+};
+
+static_assert(THREAD_POOL_SIZE <= 8U, "threadPoolUsedMask only has 8 bits");
+
+static PoolThread threadPool[THREAD_POOL_SIZE];
+static uint8_t threadPoolUsedMask = 0U;
+static uint8_t threadPoolInUse = 0U;
+static uint8_t threadPoolPeak = 0U;
+
+
+/**
+ * ThreadPoolAcquire
+ *
+ * Takes a free thread from the pool, sets it up to call the callback every
+ * interval, and adds it to the scheduler. The thread waits for one
+ * interval before it first runs.
+ * @param  callback function for the thread to run
+ * @param  interval time in milliseconds between each run
+ * @return          the thread, or NULL if the pool is empty or the scheduler
+ *                  is full.
+ */
+Thread* ThreadPoolAcquire(void (*callback)(void), unsigned long interval)
+{
+		for(uint8_t idx = 0U; idx < THREAD_POOL_SIZE; idx++)
+		{
+				if((threadPoolUsedMask & (1U << idx)) == 0U)
+				{
+						threadPool[idx].Start(callback, interval);
+						if(!controll.add(&threadPool[idx]))
+						{
+								/* the scheduler is full, so the thread would never run */
+								break;
+						}
+						threadPoolUsedMask |= (uint8_t)(1U << idx);
+
+						threadPoolInUse++;
+						if(threadPoolInUse > threadPoolPeak)
+						{
+								threadPoolPeak = threadPoolInUse;
+						}
+						return &threadPool[idx];
+				}
+		}
+
+#ifdef DEBUG
+		Serial.println("Thread pool empty or scheduler full");
+#endif
+		return NULL;
+}
+
+
+/**
+ * ThreadPoolRelease
+ *
+ * Removes a thread from the scheduler, and gives it back to the pool.
+ * @param thread thread returned by ThreadPoolAcquire, NULL is ignored.
+ */
+void ThreadPoolRelease(Thread* thread)
+{
+		for(uint8_t idx = 0U; idx < THREAD_POOL_SIZE; idx++)
+		{
+				if((thread == &threadPool[idx]) && ((threadPoolUsedMask & (1U << idx)) != 0U))
+				{
+						controll.remove(&threadPool[idx]);
+						threadPool[idx].onRun(NULL);
+						threadPoolUsedMask &= (uint8_t)~(1U << idx);
+						threadPoolInUse--;
+						return;
+				}
+		}
+}
+
+
+/**
+ * ThreadPoolInUse
+ *
+ * @return  the number of threads currently taken from the pool
+ */
+uint8_t ThreadPoolInUse(void)
+{
+		return threadPoolInUse;
+}
+
+
+/**
+ * ThreadPoolPeak
+ *
+ * @return  the largest number of threads that have been taken from the pool
+ *          at the same time since power up.
+ */
+uint8_t ThreadPoolPeak(void)
+{
+		return threadPoolPeak;
+}
@@ -0,0 +1,32 @@
+/*
+ * ThreadPool.h
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+/* Maximum number of program threads that can be running at the same time */
+#define THREAD_POOL_SIZE 6U
+
+extern Thread* ThreadPoolAcquire(void (*callback)(void), unsigned long interval);
+extern void ThreadPoolRelease(Thread* thread);
+extern uint8_t ThreadPoolInUse(void);
+extern uint8_t ThreadPoolPeak(void);
+#endif /* THREAD_POOL_H */
@@ -24,7 +24,6 @@
  */
 #include <Wire.h>
 #include <Thread.h>
-#include <ThreadController.h>
 #include <TimerOne.h>
 
 /* Open DSKY headers */
@@ -34,6 +33,8 @@
 #include "RTC.h"
 #include "GPS.h"
 #include "DiagnosticPrograms.h"
+#include "ThreadPool.h"
+#include "Scheduler.h"
 #include "main.h"
 
 
@@ -41,7 +42,7 @@
 #define MINUTES_IDX 1U
 #define SECONDS_IDX 2U
 
-static SevenSegmentDisplayStruct TimeProgramDisplayData;
+static SevenSegmentFrameStruct TimeProgramFrame;
 /* Thread handler */
 Thread* P16Thread = NULL;
 
@@ -52,11 +53,11 @@ Thread* P16Thread = NULL;
  * Returns a pointer to a structure of type SevenSegmentDisplayStruct that
  * contains the 7 Segment display data for whichever program in this module
  * is running in the FOREGROUND.
- * @return  SevenSegmentDisplayStruct pointer.
+ * @return  SevenSegmentDisplayStruct pointer to the last published frame.
  */
-SevenSegmentDisplayStruct* TimeGetDisplayData(void)
+const SevenSegmentDisplayStruct* TimeGetDisplayData(void)
 {
-		return &TimeProgramDisplayData;
+		return SevenSegmentFrontBuffer(&TimeProgramFrame);
 }
 
 
@@ -68,6 +69,7 @@ SevenSegmentDisplayStruct* TimeGetDisplayData(void)
  */
 void P16ThreadCallback(void)
 {
+		SevenSegmentDisplayStruct* displayData;
 		uint8_t hours;
 		uint8_t minutes;
 		uint8_t seconds;
@@ -84,17 +86,17 @@ void P16ThreadCallback(void)
 		Serial.println(seconds);
 #endif
 
-		TimeProgramDisplayData.R1 = (int32_t)hours;
-		TimeProgramDisplayData.R2 = (int32_t)minutes;
-		TimeProgramDisplayData.R3 = (int32_t)seconds;
+		displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, (int32_t)hours, 0x3);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, (int32_t)minutes, 0x3);
+		SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, (int32_t)seconds, 0x3);
 
 
-		TimeProgramDisplayData.Verb = 16;
-		TimeProgramDisplayData.Noun = 36;
-		TimeProgramDisplayData.Prog = 0;
-		TimeProgramDisplayData.R1DigitShowMask = 0x3;
-		TimeProgramDisplayData.R2DigitShowMask = 0x3;
-		TimeProgramDisplayData.R3DigitShowMask = 0x3;
+		displayData->Verb = SEVEN_SEGMENT_PAIR(16);
+		displayData->Noun = SEVEN_SEGMENT_PAIR(36);
+		displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+		displayData->Flags = 0U;
+		SevenSegmentPublishFrame(&TimeProgramFrame);
 
 		NeoPixelSetState(VERB_PIXEL,GREEN_COLOUR,PIXEL_ON);
 		NeoPixelSetState(NOUN_PIXEL,GREEN_COLOUR,PIXEL_ON);
@@ -120,12 +122,16 @@ void P16ThreadCallback(void)
  */
 ProgramRunStateEnum V25N36GiveData(uint8_t dataIdx,int32_t data)
 {
+		SevenSegmentDisplayStruct* displayData;
+
 		/* Set the hour first */
 		if((dataIdx == HOURS_IDX) && (data >= 0) && (data <= LARGEST_HOUR_IN_A_DAY))
 		{
 				/* Set the RTC value, then display it */
 				RtcSetHour((uint8_t)(data));
-				TimeProgramDisplayData.R1 = data;
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, data, 0x3);
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				return FOREGROUND;
 		}
 		/* Set the minutes second */
@@ -133,7 +139,9 @@ ProgramRunStateEnum V25N36GiveData(uint8_t dataIdx,int32_t data)
 		{
 				/* Set the RTC value, then display it */
 				RtcSetMinute((uint8_t)(data));
-				TimeProgramDisplayData.R2 = data;
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, data, 0x3);
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				return FOREGROUND;
 		}
 		/* Set the seconds third */
@@ -141,7 +149,11 @@ ProgramRunStateEnum V25N36GiveData(uint8_t dataIdx,int32_t data)
 		{
 				/* Set the RTC value, then display it */
 				RtcSetSecond((uint8_t)(data));
-				TimeProgramDisplayData.R3 = data;
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, data, 0x3);
+				/* The time has been loaded, so stop flashing */
+				displayData->Flags = 0U;
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				/* RTC time has finished being entered so now call the program that
 				   shos the current time. */
 				SetProgram(16, 36, START_PROGRAM);
@@ -164,6 +176,7 @@ ProgramRunStateEnum V25N36GiveData(uint8_t dataIdx,int32_t data)
  */
 ProgramRunStateEnum V25N36LoadManualTime(ProgramCallStateEnum call)
 {
+		SevenSegmentDisplayStruct* displayData;
 
 		switch(call)
 		{
@@ -171,15 +184,16 @@ ProgramRunStateEnum V25N36LoadManualTime(ProgramCallStateEnum call)
 		case BRING_PROGRAM_TO_FOREGROUND:
 		case RESET_PROGRAM:
 				/* Clear out the display data ready for input */
-				TimeProgramDisplayData.R1 = 0;
-				TimeProgramDisplayData.R2 = 0;
-				TimeProgramDisplayData.R3 = 9;
-				TimeProgramDisplayData.Verb = 25;
-				TimeProgramDisplayData.Noun = 36;
-				TimeProgramDisplayData.Prog = 0;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, 0, 0x3);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, 0, 0x3);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, 9, 0x3);
+				displayData->Verb = SEVEN_SEGMENT_PAIR(25);
+				displayData->Noun = SEVEN_SEGMENT_PAIR(36);
+				displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+				/* flash VERB NOUN until the data has been loaded */
+				displayData->Flags = SEVEN_SEGMENT_FLASH_VERB | SEVEN_SEGMENT_FLASH_NOUN;
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				return FOREGROUND;
 				break;
 
@@ -210,6 +224,8 @@ ProgramRunStateEnum V25N36LoadManualTime(ProgramCallStateEnum call)
  */
 ProgramRunStateEnum V26N36GiveData(uint8_t dataIdx,int32_t data)
 {
+		SevenSegmentDisplayStruct* displayData;
+
 		/* Set the hour first */
 		if((dataIdx == HOURS_IDX) && (data <= LARGEST_HOUR_IN_A_DAY) && (data >= (-1* LARGEST_HOUR_IN_A_DAY)))
 		{
@@ -228,6 +244,10 @@ ProgramRunStateEnum V26N36GiveData(uint8_t dataIdx,int32_t data)
 				}
 				RtcSetMinute(GPSGetMinute());
 				RtcSetSecond(GPSGetSecond());
+				/* The offset has been loaded, so stop flashing */
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				displayData->Flags = 0U;
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				/* Show the time on the sevne segment diplays */
 				SetProgram(16, 36, START_PROGRAM);
 				return NOT_RUNNING;
@@ -249,21 +269,24 @@ ProgramRunStateEnum V26N36GiveData(uint8_t dataIdx,int32_t data)
  */
 ProgramRunStateEnum V26N36LoadGPSTime(ProgramCallStateEnum call)
 {
+		SevenSegmentDisplayStruct* displayData;
+
 		switch(call)
 		{
 		case START_PROGRAM:
 		case BRING_PROGRAM_TO_FOREGROUND:
 		case RESET_PROGRAM:
 				/* Clear out the display data ready for input */
-				TimeProgramDisplayData.R1 = 0;
-				TimeProgramDisplayData.R2 = 0;
-				TimeProgramDisplayData.R3 = 9;
-				TimeProgramDisplayData.Verb = 25;
-				TimeProgramDisplayData.Noun = 36;
-				TimeProgramDisplayData.Prog = 0;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, 0, 0x3);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, 0, 0x3);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, 9, 0x3);
+				displayData->Verb = SEVEN_SEGMENT_PAIR(25);
+				displayData->Noun = SEVEN_SEGMENT_PAIR(36);
+				displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+				/* flash VERB NOUN until the data has been loaded */
+				displayData->Flags = SEVEN_SEGMENT_FLASH_VERB | SEVEN_SEGMENT_FLASH_NOUN;
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				return FOREGROUND;
 				break;
 
@@ -304,14 +327,11 @@ ProgramRunStateEnum V16N36ShowRTCTime(ProgramCallStateEnum call)
 				   able to periodically update the displayed time */
 				if(P16Thread == NULL)
 				{
-						/* Create a new thread and set it to update three times a second,
+						/* Take a thread from the pool and set it to update three times a second,
 						   you could get away with only updating the data once a second, but
 						   doing it more often makes it appear smoother to the user. */
-						P16Thread = new Thread();
-						P16Thread->onRun(P16ThreadCallback);
-						P16Thread->setInterval(333);
-						controll.add(P16Thread);
-						return FOREGROUND;
+						P16Thread = ThreadPoolAcquire(P16ThreadCallback, 333);
+						return (P16Thread != NULL) ? FOREGROUND : NOT_RUNNING;
 				}
 
 				break;
@@ -323,11 +343,10 @@ ProgramRunStateEnum V16N36ShowRTCTime(ProgramCallStateEnum call)
 		case STOP_PROGRAM:
 		case NUM_CALL_STATES:
 		default:
-				/* If the thred exists, delete it */
+				/* If the thread exists, give it back to the pool */
 				if(P16Thread != NULL)
 				{
-						controll.remove(P16Thread);
-						delete[] P16Thread;
+						ThreadPoolRelease(P16Thread);
 						P16Thread = NULL;
 				}
 				return NOT_RUNNING;
@@ -349,21 +368,24 @@ ProgramRunStateEnum V16N36ShowRTCTime(ProgramCallStateEnum call)
  */
 ProgramRunStateEnum V37N36SetAlarmProg(ProgramCallStateEnum call)
 {
+		SevenSegmentDisplayStruct* displayData;
+
 		switch(call)
 		{
 		case START_PROGRAM:
 		case BRING_PROGRAM_TO_FOREGROUND:
 		case RESET_PROGRAM:
 				/* Clear out the display data ready for input */
-				TimeProgramDisplayData.R1 = 0;
-				TimeProgramDisplayData.R2 = 0;
-				TimeProgramDisplayData.R3 = 9;
-				TimeProgramDisplayData.Verb = 37;
-				TimeProgramDisplayData.Noun = 36;
-				TimeProgramDisplayData.Prog = 0;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
-				TimeProgramDisplayData.R1DigitShowMask = 0x3;
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R1, 0, 0x3);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R2, 0, 0x3);
+				SevenSegmentSetDigits(displayData, SEVEN_SEGMENT_R3, 9, 0x3);
+				displayData->Verb = SEVEN_SEGMENT_PAIR(37);
+				displayData->Noun = SEVEN_SEGMENT_PAIR(36);
+				displayData->Prog = SEVEN_SEGMENT_PAIR(0);
+				/* flash VERB NOUN until the data has been loaded */
+				displayData->Flags = SEVEN_SEGMENT_FLASH_VERB | SEVEN_SEGMENT_FLASH_NOUN;
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				return FOREGROUND;
 				break;
 
@@ -394,6 +416,7 @@ ProgramRunStateEnum V37N36SetAlarmProg(ProgramCallStateEnum call)
  */
 ProgramRunStateEnum V37N36GiveData(uint8_t DataIdx,int32_t data)
 {
+		SevenSegmentDisplayStruct* displayData;
 		static uint8_t day;
 		static uint8_t hour;
 		static uint8_t minute;
@@ -471,6 +494,10 @@ ProgramRunStateEnum V37N36GiveData(uint8_t DataIdx,int32_t data)
 				}
 #endif
 				RtcSetAlarmProgram( day,  hour,  minute,  second,  verb,  noun, progData,  repeat);
+				/* The alarm has been loaded, so stop flashing */
+				displayData = SevenSegmentBeginFrame(&TimeProgramFrame);
+				displayData->Flags = 0U;
+				SevenSegmentPublishFrame(&TimeProgramFrame);
 				return NOT_RUNNING;
 				break;
 		default:
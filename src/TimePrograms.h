@@ -25,7 +25,7 @@
 #ifndef TIME_PROGRAM_H
 #define TIME_PROGRAM_H
 
-extern SevenSegmentDisplayStruct* TimeGetDisplayData(void);
+extern const SevenSegmentDisplayStruct* TimeGetDisplayData(void);
 
 extern void V16N36ThreadCallback(void);
 extern ProgramRunStateEnum V25N36GiveData(uint8_t dataIdx,int32_t data);
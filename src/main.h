@@ -25,4 +25,4 @@
  */
 
 
-extern ThreadController controll;
+extern Scheduler controll;
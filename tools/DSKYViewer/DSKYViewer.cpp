@@ -0,0 +1,455 @@
+/*
+ * DSKYViewer.cpp
+ *
+ * Copyright 2018 Jeffrey Marten Gillmor
+ *
+ * OpenDSKY is a trademark of S&T GeoTronics LLC  https://opendsky.com
+ *
+ * Shows the 7 segment display of an Open DSKY in a Linux terminal. Build the
+ * firmware with SERIAL_MIRROR defined in SevenSegment.cpp, and the display
+ * is sent over the USB serial port as binary frames whenever it changes.
+ *
+ * Build with:
+ *     g++ -O2 -o DSKYViewer DSKYViewer.cpp
+ *
+ * Run with:
+ *     ./DSKYViewer /dev/ttyUSB0 [baud]
+ *
+ * The baud rate defaults to 9600, the same as Serial.begin() in
+ * ArduOpenDSKY.ino. Give - as the port to read a captured stream from stdin.
+ *
+ * Each frame is COBS encoded and ends with a 0. Once decoded, the first byte
+ * has a bit set for each part of the display that follows, bit 0 for PROG
+ * VERB NOUN, bits 1 to 3 for R1 to R3, then come 3 bytes for each part, and
+ * a checksum that makes all of the bytes add up to 0. Each nibble of a part
+ * is one digit, 0-9, A for plus, B for minus, anything else is blank.
+ * Anything else on the serial port, such as debug prints, fails the checksum
+ * and is ignored.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * (GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define MIRROR_NUM_PARTS    4U
+#define MIRROR_PART_BYTES   3U
+#define MIRROR_MAX_DATA     (1U + (MIRROR_NUM_PARTS * MIRROR_PART_BYTES) + 1U)
+#define MIRROR_MAX_FRAME    (MIRROR_MAX_DATA + 2U)
+
+#define NIBBLE_PLUS  0xAU
+#define NIBBLE_MINUS 0xBU
+
+/* VT100 codes for clearing the screen and going back to the top */
+#define CLS  "\033[2J"
+#define HOME "\033[H"
+
+/* The display, PROG VERB NOUN then R1 to R3, as the firmware keeps it.
+   Verb is first, then Prog, then Noun. */
+static uint8_t display[MIRROR_NUM_PARTS * MIRROR_PART_BYTES];
+
+static unsigned long goodFrames = 0UL;
+static unsigned long badFrames = 0UL;
+
+
+/**
+ * BaudToSpeed
+ *
+ * @param  baud baud rate
+ * @return      termios speed for the baud rate, B0 if it isn't supported
+ */
+static speed_t BaudToSpeed(long baud)
+{
+		switch(baud)
+		{
+		case 9600:
+				return B9600;
+		case 19200:
+				return B19200;
+		case 38400:
+				return B38400;
+		case 57600:
+				return B57600;
+		case 115200:
+				return B115200;
+		default:
+				return B0;
+		}
+}
+
+
+/**
+ * OpenPort
+ *
+ * Opens the serial port as a raw 8N1 port.
+ * @param  path path of the serial port, - for stdin
+ * @param  baud baud rate
+ * @return      file descriptor, -1 on error
+ */
+static int OpenPort(const char* path, long baud)
+{
+		struct termios tty;
+		speed_t speed = BaudToSpeed(baud);
+		int fd;
+
+		if(strcmp(path, "-") == 0)
+		{
+				return STDIN_FILENO;
+		}
+
+		if(speed == B0)
+		{
+				fprintf(stderr, "Unsupported baud rate %ld\n", baud);
+				return -1;
+		}
+
+		fd = open(path, O_RDONLY | O_NOCTTY);
+		if(fd < 0)
+		{
+				fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+				return -1;
+		}
+
+		if(tcgetattr(fd, &tty) != 0)
+		{
+				fprintf(stderr, "Can't read the settings of %s: %s\n", path, strerror(errno));
+				close(fd);
+				return -1;
+		}
+		cfmakeraw(&tty);
+		cfsetispeed(&tty, speed);
+		cfsetospeed(&tty, speed);
+		tty.c_cflag |= (CLOCAL | CREAD);
+		tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+		tty.c_cc[VMIN] = 1;
+		tty.c_cc[VTIME] = 0;
+		if(tcsetattr(fd, TCSANOW, &tty) != 0)
+		{
+				fprintf(stderr, "Can't set up %s: %s\n", path, strerror(errno));
+				close(fd);
+				return -1;
+		}
+		return fd;
+}
+
+
+/**
+ * Decode
+ *
+ * COBS decodes a frame, without the 0 on the end.
+ * @param  encoded the encoded frame
+ * @param  length  number of encoded bytes
+ * @param  data    filled with the decoded bytes
+ * @return         number of decoded bytes, 0 if the frame is broken
+ */
+static size_t Decode(const uint8_t* encoded, size_t length, uint8_t* data)
+{
+		size_t in = 0U;
+		size_t out = 0U;
+
+		while(in < length)
+		{
+				uint8_t code = encoded[in];
+
+				if((code == 0U) || ((in + code) > length))
+				{
+						return 0U;
+				}
+				in++;
+				for(uint8_t idx = 1U; idx < code; idx++)
+				{
+						data[out] = encoded[in];
+						out++;
+						in++;
+				}
+				if((code < 0xFFU) && (in < length))
+				{
+						data[out] = 0U;
+						out++;
+				}
+		}
+		return out;
+}
+
+
+/**
+ * ApplyFrame
+ *
+ * Checks a decoded frame, and copies the parts that it holds into the display.
+ * @param  data   the decoded frame
+ * @param  length number of bytes in the frame
+ * @return        true if the frame was good
+ */
+static bool ApplyFrame(const uint8_t* data, size_t length)
+{
+		uint8_t sum = 0U;
+		size_t expected = 2U;
+		size_t in = 1U;
+
+		if(length < 2U)
+		{
+				return false;
+		}
+		for(uint8_t part = 0U; part < MIRROR_NUM_PARTS; part++)
+		{
+				if((data[0] & (1U << part)) != 0U)
+				{
+						expected += MIRROR_PART_BYTES;
+				}
+		}
+		if(((data[0] >> MIRROR_NUM_PARTS) != 0U) || (length != expected))
+		{
+				return false;
+		}
+		for(size_t idx = 0U; idx < length; idx++)
+		{
+				sum += data[idx];
+		}
+		if(sum != 0U)
+		{
+				return false;
+		}
+
+		for(uint8_t part = 0U; part < MIRROR_NUM_PARTS; part++)
+		{
+				if((data[0] & (1U << part)) != 0U)
+				{
+						memcpy(&display[part * MIRROR_PART_BYTES], &data[in], MIRROR_PART_BYTES);
+						in += MIRROR_PART_BYTES;
+				}
+		}
+		return true;
+}
+
+
+/**
+ * Segments
+ *
+ * @param  nibble digit of the display
+ * @return        the 7 segments to light, in the same order as the MAX7219,
+ *                A is bit 6 down to G in bit 0.
+ */
+static uint8_t Segments(uint8_t nibble)
+{
+		static const uint8_t digitSegments[10] =
+		{
+				0x7EU, 0x30U, 0x6DU, 0x79U, 0x33U, 0x5BU, 0x5FU, 0x70U, 0x7FU, 0x7BU
+		};
+
+		return (nibble < 10U) ? digitSegments[nibble] : 0U;
+}
+
+
+/**
+ * DrawDigits
+ *
+ * Draws one line of a run of digits, each is 3 characters wide and 3 lines
+ * tall.
+ * @param nibbles digits to draw
+ * @param count   number of digits
+ * @param line    0 to 2, top to bottom
+ */
+static void DrawDigits(const uint8_t* nibbles, uint8_t count, uint8_t line)
+{
+		for(uint8_t idx = 0U; idx < count; idx++)
+		{
+				uint8_t nibble = nibbles[idx];
+				uint8_t seg = Segments(nibble);
+
+				if(nibble == NIBBLE_PLUS)
+				{
+						fputs((line == 1U) ? "-+-" : "   ", stdout);
+				}
+				else if(nibble == NIBBLE_MINUS)
+				{
+						fputs((line == 1U) ? "---" : "   ", stdout);
+				}
+				else if(line == 0U)
+				{
+						putchar(' ');
+						putchar((seg & 0x40U) ? '_' : ' ');
+						putchar(' ');
+				}
+				else if(line == 1U)
+				{
+						putchar((seg & 0x02U) ? '|' : ' ');
+						putchar((seg & 0x01U) ? '_' : ' ');
+						putchar((seg & 0x20U) ? '|' : ' ');
+				}
+				else
+				{
+						putchar((seg & 0x04U) ? '|' : ' ');
+						putchar((seg & 0x08U) ? '_' : ' ');
+						putchar((seg & 0x10U) ? '|' : ' ');
+				}
+				putchar(' ');
+		}
+}
+
+
+/**
+ * Unpack
+ *
+ * Splits packed bytes into one nibble per digit.
+ * @param packed   bytes to split
+ * @param numBytes number of bytes
+ * @param nibbles  filled with numBytes * 2 digits
+ */
+static void Unpack(const uint8_t* packed, uint8_t numBytes, uint8_t* nibbles)
+{
+		for(uint8_t idx = 0U; idx < numBytes; idx++)
+		{
+				nibbles[idx * 2U] = packed[idx] >> 4;
+				nibbles[(idx * 2U) + 1U] = packed[idx] & 0x0FU;
+		}
+}
+
+
+/**
+ * Draw
+ *
+ * Draws the whole display, laid out like the DSKY.
+ */
+static void Draw(void)
+{
+		uint8_t verb[2];
+		uint8_t prog[2];
+		uint8_t noun[2];
+		uint8_t reg[6];
+
+		Unpack(&display[0], 1U, verb);
+		Unpack(&display[1], 1U, prog);
+		Unpack(&display[2], 1U, noun);
+
+		fputs(HOME, stdout);
+		printf("                  PROG\n");
+		for(uint8_t line = 0U; line < 3U; line++)
+		{
+				printf("                  ");
+				DrawDigits(prog, 2U, line);
+				putchar('\n');
+		}
+		printf("  VERB            NOUN\n");
+		for(uint8_t line = 0U; line < 3U; line++)
+		{
+				printf("  ");
+				DrawDigits(verb, 2U, line);
+				printf("        ");
+				DrawDigits(noun, 2U, line);
+				putchar('\n');
+		}
+		for(uint8_t idx = 0U; idx < 3U; idx++)
+		{
+				printf("  ------------------------\n");
+				Unpack(&display[(idx + 1U) * MIRROR_PART_BYTES], MIRROR_PART_BYTES, reg);
+				for(uint8_t line = 0U; line < 3U; line++)
+				{
+						printf("  ");
+						DrawDigits(reg, 6U, line);
+						putchar('\n');
+				}
+		}
+		printf("\n  frames %lu  bad %lu\n", goodFrames, badFrames);
+		fflush(stdout);
+}
+
+
+int main(int argc, char* argv[])
+{
+		uint8_t encoded[MIRROR_MAX_FRAME];
+		uint8_t data[MIRROR_MAX_FRAME];
+		size_t length = 0U;
+		bool overflow = false;
+		long baud = 9600L;
+		int fd;
+
+		if(argc < 2)
+		{
+				fprintf(stderr, "Usage: %s <serial port|-> [baud]\n", argv[0]);
+				return 1;
+		}
+		if(argc > 2)
+		{
+				baud = strtol(argv[2], NULL, 10);
+		}
+
+		fd = OpenPort(argv[1], baud);
+		if(fd < 0)
+		{
+				return 1;
+		}
+
+		/* start off blank */
+		memset(display, 0xFF, sizeof(display));
+		fputs(CLS, stdout);
+		Draw();
+
+		for(;;)
+		{
+				uint8_t buffer[64];
+				ssize_t got = read(fd, buffer, sizeof(buffer));
+
+				if(got <= 0)
+				{
+						if((got < 0) && (errno == EINTR))
+						{
+								continue;
+						}
+						break;
+				}
+
+				for(ssize_t idx = 0; idx < got; idx++)
+				{
+						if(buffer[idx] != 0U)
+						{
+								if(length < sizeof(encoded))
+								{
+										encoded[length] = buffer[idx];
+										length++;
+								}
+								else
+								{
+										overflow = true;
+								}
+								continue;
+						}
+
+						/* end of a frame */
+						if(!overflow && ApplyFrame(data, Decode(encoded, length, data)))
+						{
+								goodFrames++;
+								Draw();
+						}
+						else if(length > 0U)
+						{
+								badFrames++;
+						}
+						length = 0U;
+						overflow = false;
+				}
+		}
+
+		putchar('\n');
+		if(fd != STDIN_FILENO)
+		{
+				close(fd);
+		}
+		return 0;
+}